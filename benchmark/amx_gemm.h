@@ -1,58 +1,117 @@
 #pragma once
 
+#include <algorithm>
 #include <type_traits>
 
 #include "gemm.h"
+#include "registry.h"
 
-#if USE_AMX == 1
-#include "../src/amx_sgemm.1.h"
-#elif USE_AMX == 2
-#include "../src/amx_sgemm.2.h"
-#elif USE_AMX == 3
-#include "../src/amx_sgemm.3.h"
-#else
+// the kernel is picked per call, $AMX_SGEMM_KERNEL=1, 2 or 3 forces one
 #include "../src/amx_sgemm.h"
-#endif
 
 template <class T> class AMXGEMM : public GEMM<T>
 {
 protected:
-    size_t n;
     T *a;
     T *b;
     T *c;
+    bool own_b = true;
+    // AMX_SGEMM_AUTO for _amx_sgemm, or always this kernel
+    enum AMX_SGEMM_KERNEL kernel;
 
 public:
-    AMXGEMM(size_t n)
-        : n(n), a(new (std::align_val_t{128}) T[n * n]),
-          b(new (std::align_val_t{128}) T[n * n]),
-          c(new (std::align_val_t{128}) T[n * n])
-    // : n(n), a(new T[n * n]), b(new T[n * n]), c(new T[n * n])
+    AMXGEMM(size_t m, size_t n, size_t k,
+            enum AMX_SGEMM_KERNEL kernel = AMX_SGEMM_AUTO)
+        : GEMM<T>(m, n, k), a(new (std::align_val_t{128}) T[m * k]),
+          b(new (std::align_val_t{128}) T[k * n]),
+          c(new (std::align_val_t{128}) T[m * n]), kernel(kernel)
     {
     }
 
     ~AMXGEMM()
     {
         delete[] a;
-        delete[] b;
+        if (own_b) {
+            delete[] b;
+        }
         delete[] c;
     }
 
     virtual void run()
     {
         if constexpr (std::is_same<T, float>::value) {
-            amx_sgemm(a, b, c, n);
+            if (kernel == AMX_SGEMM_AUTO) {
+                _amx_sgemm(a, b, c, this->m, this->n, this->k);
+            } else {
+                amx_sgemm_run(kernel, a, b, c, this->m, this->n, this->k);
+            }
         }
     }
 
-    virtual void init_matrices()
+    // the kernels take multiples of 32, of 64 for the columns of
+    // AMX_SGEMM_PACK_A
+    virtual bool supported() const
     {
-        for (int i = 0; i < n; i++) {
-            for (int j = 0; j < n; j++) {
-                a[i * n + j] = static_cast<T>(1.0);
-                b[i * n + j] = static_cast<T>(1.0);
-                c[i * n + j] = static_cast<T>(0.0);
-            }
+        return std::is_same<T, float>::value &&
+               amx_sgemm_kernel_supported(
+                   kernel == AMX_SGEMM_AUTO
+                       ? amx_sgemm_choose(this->m, this->n, this->k)
+                       : kernel,
+                   this->m, this->n, this->k);
+    }
+
+    virtual std::string name() const
+    {
+        if (kernel != AMX_SGEMM_AUTO) {
+            return "amx-" + std::to_string(kernel);
+        }
+        if (amx_sgemm_kernel_override == AMX_SGEMM_AUTO) {
+            return "amx";
+        }
+        return "amx-" + std::to_string(amx_sgemm_kernel_override);
+    }
+
+    virtual int threads() const { return 1; }
+
+    virtual bool share_b(GEMM<T> *owner)
+    {
+        AMXGEMM *other = dynamic_cast<AMXGEMM *>(owner);
+        if (other == nullptr || other->k != this->k || other->n != this->n) {
+            return false;
+        }
+        if (own_b) {
+            delete[] b;
         }
+        b = other->b;
+        own_b = false;
+        return true;
+    }
+
+    virtual void init_matrices(const T *a, const T *b)
+    {
+        std::copy(a, a + this->m * this->k, this->a);
+        std::copy(b, b + this->k * this->n, this->b);
+        std::fill(c, c + this->m * this->n, static_cast<T>(0.0));
+    }
+
+    virtual void read_result(T *c) const
+    {
+        std::copy(this->c, this->c + this->m * this->n, c);
     }
 };
+
+// amx picks the kernel of every call, amx-1, amx-2 and amx-3 force one
+template <class T, enum AMX_SGEMM_KERNEL kernel>
+GEMM<T> *make_amx_gemm(size_t m, size_t n, size_t k)
+{
+    return new AMXGEMM<T>(m, n, k, kernel);
+}
+
+static const bool amx_registered =
+    register_backend<float>("amx", make_amx_gemm<float, AMX_SGEMM_AUTO>) &&
+    register_backend<float>("amx-1", make_amx_gemm<float, AMX_SGEMM_NO_PACK>,
+                            false) &&
+    register_backend<float>("amx-2", make_amx_gemm<float, AMX_SGEMM_PACK_A>,
+                            false) &&
+    register_backend<float>("amx-3", make_amx_gemm<float, AMX_SGEMM_PACK_AB>,
+                            false);
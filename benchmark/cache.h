@@ -0,0 +1,74 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// cache state of the trials
+//   warm: every trial runs on the data of the previous one
+//   cold: the caches are flushed before every trial (not timed)
+//   rotate: every trial uses another copy of A, B and C, the copies are
+//     larger than the flush buffer together
+enum class CacheMode { Warm, Cold, Rotate };
+
+inline const char *cache_mode_name(CacheMode mode)
+{
+    switch (mode) {
+    case CacheMode::Cold:
+        return "cold";
+    case CacheMode::Rotate:
+        return "rotate";
+    default:
+        return "warm";
+    }
+}
+
+// "warm,cold,rotate" or "all"
+inline bool parse_cache_modes(const std::string &text,
+                              std::vector<CacheMode> &modes)
+{
+    modes.clear();
+    std::istringstream words(text);
+    for (std::string word; std::getline(words, word, ',');) {
+        if (word == "all") {
+            modes = {CacheMode::Warm, CacheMode::Cold, CacheMode::Rotate};
+        } else if (word == "warm") {
+            modes.push_back(CacheMode::Warm);
+        } else if (word == "cold") {
+            modes.push_back(CacheMode::Cold);
+        } else if (word == "rotate") {
+            modes.push_back(CacheMode::Rotate);
+        } else {
+            return false;
+        }
+    }
+    return !modes.empty();
+}
+
+// reads a buffer larger than the last level cache. reading does not leave
+// dirty lines to be written back in the next trial, and the buffer is
+// written once so that it is not all one shared zero page
+class CacheFlusher
+{
+    std::vector<unsigned char> buffer;
+    volatile unsigned long sink = 0; // so that the reads are not dropped
+
+  public:
+    explicit CacheFlusher(size_t bytes) : buffer(bytes)
+    {
+        for (size_t i = 0; i < bytes; i++) {
+            buffer[i] = static_cast<unsigned char>(i * 131);
+        }
+    }
+
+    size_t size() const { return buffer.size(); }
+
+    void flush()
+    {
+        unsigned long sum = 0;
+        for (size_t i = 0; i < buffer.size(); i += 64) {
+            sum += buffer[i];
+        }
+        sink = sum;
+    }
+};
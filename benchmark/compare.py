@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+"""
+compare gemm_bench results with a baseline, shape by shape
+
+    ./compare.py -b result -c new.json [-t 0.05] [-s 3] [-p compare]
+
+baselines and current results are .dat files (the table gemm_bench prints,
+the backend is the file name or the last column) or the -o .json files, or
+directories of them. a shape regresses when its GFLOP/s drops by more than
+its threshold: -t (5%), or -s times the noise of both runs if that is larger,
+but never more than -m (50%). the noise is the standard error of the median
+from the cv and the count of trials in .json files, the cv in .dat files
+(they have no count of trials), and for the old 5 column .dat files the gap
+between the mean and the min runtime. GFLOP/s of the median are compared
+when both sides have them, else GFLOP/s of the fastest trial, which is what
+the old .dat files have.
+
+exits with 1 if a shape regressed or failed its verification, with or without
+a baseline, with 2 if no shape matched the baseline, and writes a gnuplot
+chart of both runs with -p.
+"""
+import argparse
+import json
+import math
+import os
+import shutil
+import subprocess
+import sys
+
+
+class Record:
+    def __init__(self, backend, m, n, k, cache='warm', workers=1):
+        self.backend = backend
+        self.m, self.n, self.k = m, n, k
+        self.cache = cache
+        self.workers = workers
+        self.median = None  # GFLOP/s of the median trial
+        self.best = None    # GFLOP/s of the fastest trial
+        self.noise = 0.0    # relative
+        self.passed = True
+
+    def key(self):
+        return (self.backend, self.m, self.n, self.k, self.cache, self.workers)
+
+    def shape(self):
+        if self.m == self.n == self.k:
+            return str(self.n)
+        return '{}x{}x{}'.format(self.m, self.n, self.k)
+
+
+def read_dat(path):
+    records = []
+    backend = os.path.splitext(os.path.basename(path))[0]
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if not fields or not fields[0].isdigit():
+                continue  # header, # lines
+            n = int(fields[0])
+            gflops = float(fields[1])
+            mean, low = float(fields[2]), float(fields[3])
+            if len(fields) < 8:
+                # before median statistics: GFLOP/s of the min runtime
+                r = Record(backend, n, n, n)
+                r.best = gflops
+                r.noise = (mean - low) / mean if mean > 0 else 0.0
+            else:
+                # GFLOP/s of the min runtime, then M, K, median, GFLOP/s of it
+                m, k = int(fields[5]), int(fields[6])
+                r = Record(fields[18] if len(fields) > 18 else backend, m, n, k)
+                if len(fields) > 16:
+                    r.cache = fields[16]
+                if len(fields) > 17:
+                    r.workers = int(fields[17])
+                r.best = gflops
+                r.median = float(fields[8])
+                r.noise = float(fields[12])
+            records.append(r)
+    return records
+
+
+def read_json(path):
+    records = []
+    with open(path) as f:
+        for result in json.load(f):
+            r = Record(result['backend'], result['m'], result['n'], result['k'],
+                       result.get('cache', 'warm'), result.get('workers', 1))
+            r.median = result['gflops']
+            r.best = result['peak_gflops']
+            # of the median of normally distributed trials
+            trials = max(1, result.get('trials', 1))
+            r.noise = 1.2533 * result.get('cv', 0.0) / math.sqrt(trials)
+            r.passed = result.get('passed', True)
+            records.append(r)
+    return records
+
+
+def read(paths):
+    files = []
+    for path in paths:
+        if os.path.isdir(path):
+            files += sorted(os.path.join(path, name) for name in os.listdir(path)
+                            if name.endswith('.dat') or name.endswith('.json'))
+        else:
+            files.append(path)
+    records = {}
+    for path in files:
+        for r in read_json(path) if path.endswith('.json') else read_dat(path):
+            records[r.key()] = r
+    return records
+
+
+def compare(baseline, current, threshold, sigmas, max_threshold):
+    """rows of (baseline, current, old, new, change, allowed, verdict), a
+    failed shape without a baseline has None for all but current and verdict"""
+    rows = []
+    for key in sorted(current, key=lambda key: (key[0], key[1] * key[2] * key[3], key[1:])):
+        c = current[key]
+        b = baseline.get(key)
+        if b is None:
+            if not c.passed:
+                rows.append((None, c, None, None, None, None, 'FAILED'))
+            continue
+        if b.median is not None and c.median is not None:
+            old, new = b.median, c.median
+        else:
+            old, new = b.best, c.best
+        if not old or new is None:
+            continue
+        change = new / old - 1
+        allowed = max(threshold, sigmas * math.sqrt(b.noise ** 2 + c.noise ** 2))
+        allowed = min(allowed, max(threshold, max_threshold))
+        if not c.passed:
+            verdict = 'FAILED'
+        elif change < -allowed:
+            verdict = 'REGRESSION'
+        elif change > allowed:
+            verdict = 'faster'
+        else:
+            verdict = 'same'
+        rows.append((b, c, old, new, change, allowed, verdict))
+    return rows
+
+
+def plot(rows, directory):
+    """one line per backend and run, shapes in the order of the rows"""
+    os.makedirs(directory, exist_ok=True)
+    backends = []
+    rows = [row for row in rows if row[0] is not None]
+    for b, c, old, new, change, allowed, verdict in rows:
+        if b.backend not in backends:
+            backends.append(b.backend)
+    lines = []
+    for backend in backends:
+        for run, index in (('baseline', 2), ('current', 3)):
+            name = '{}.{}.dat'.format(backend, run)
+            with open(os.path.join(directory, name), 'w') as f:
+                x = 0
+                for row in rows:
+                    if row[0].backend == backend:
+                        f.write('{} {} {}\n'.format(x, row[0].shape(), row[index]))
+                        x += 1
+            lines.append('"{}" u 1:3:xtic(2) w lines t "{} {}" lw 2{}'.format(
+                name, backend, run, ' dt 2' if run == 'baseline' else ''))
+    with open(os.path.join(directory, 'compare.gpi'), 'w') as f:
+        f.write('set terminal pngcairo size 1024,640\n')
+        f.write('set output "compare.png"\n\n')
+        f.write('set title "SGEMM, baseline (dashed) and current"\n')
+        f.write('set xlabel "shape"\n')
+        f.write('set ylabel "GFLOP/s"\n')
+        f.write('set yrange [0.0:*]\n')
+        f.write('set xtics rotate by -45\n')
+        f.write('set key top left box\n\n')
+        f.write('plot ' + ', \\\n     '.join(lines) + '\n\n')
+        f.write('unset output\n')
+    if shutil.which('gnuplot'):
+        subprocess.call(['gnuplot', 'compare.gpi'], cwd=directory)
+        return os.path.join(directory, 'compare.png')
+    return os.path.join(directory, 'compare.gpi')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='compare gemm_bench results with a baseline')
+    parser.add_argument('-b', '--baseline', nargs='+', required=True, help='.dat/.json files or directories')
+    parser.add_argument('-c', '--current', nargs='+', required=True, help='.dat/.json files or directories')
+    parser.add_argument('-t', '--threshold', type=float, default=0.05, help='smallest drop that regresses (0.05)')
+    parser.add_argument('-s', '--sigmas', type=float, default=3.0, help='drop in units of the noise (3)')
+    parser.add_argument('-m', '--max-threshold', type=float, default=0.5, help='largest allowed drop of noisy shapes (0.5)')
+    parser.add_argument('-p', '--plot', help='directory for compare.gpi, its data and compare.png')
+    args = parser.parse_args()
+
+    baseline = read(args.baseline)
+    current = read(args.current)
+    rows = compare(baseline, current, args.threshold, args.sigmas, args.max_threshold)
+    print('{:<12}{:<18}{:<8}{:<9}{:>12}{:>12}{:>10}{:>10}  {}'.format(
+        'backend', 'shape', 'cache', 'workers', 'baseline', 'current', 'change', 'allowed', 'verdict'))
+    for b, c, old, new, change, allowed, verdict in rows:
+        if b is None:
+            print('{:<12}{:<18}{:<8}{:<9}{:>12}{:>12}{:>10}{:>10}  {}'.format(
+                c.backend, c.shape(), c.cache, c.workers, '-', '-', '-', '-', verdict))
+            continue
+        print('{:<12}{:<18}{:<8}{:<9}{:>12.3f}{:>12.3f}{:>+9.1f}%{:>9.1f}%  {}'.format(
+            c.backend, c.shape(), c.cache, c.workers, old, new, 100 * change, 100 * allowed, verdict))
+    missing = [key for key in current if key not in baseline]
+    if missing:
+        print('{} shapes without a baseline: {}'.format(
+            len(missing), ', '.join(sorted(set(key[0] for key in missing)))), file=sys.stderr)
+    compared = [row for row in rows if row[0] is not None]
+    if args.plot and compared:
+        print('chart: ' + plot(rows, args.plot))
+    failed = [row for row in rows if row[-1] in ('REGRESSION', 'FAILED')]
+    if failed:
+        print('{} of {} shapes regressed or failed'.format(len(failed), len(rows)), file=sys.stderr)
+        return 1
+    if not compared:
+        print('no shape matches the baseline, check the backends and shapes of both', file=sys.stderr)
+        return 2
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -4,27 +4,47 @@
 #include <type_traits>
 
 #include "gemm.h"
+#include "registry.h"
 
 template <class T> class EigenGEMM : public GEMM<T>
 {
 protected:
     using Mat = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
-    size_t n;
+    using RowMajorMap =
+        Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic,
+                                 Eigen::RowMajor>>;
+    using ConstRowMajorMap =
+        Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic,
+                                       Eigen::RowMajor>>;
     Mat a;
     Mat b;
     Mat c;
 
 public:
-    EigenGEMM(size_t n) : n(n), a(n, n), b(n, n), c(n, n) {}
+    EigenGEMM(size_t m, size_t n, size_t k)
+        : GEMM<T>(m, n, k), a(m, k), b(k, n), c(m, n)
+    {
+    }
 
     ~EigenGEMM() {}
 
     virtual void run() { c = a * b; }
 
-    virtual void init_matrices()
+    virtual std::string name() const { return "eigen"; }
+
+    virtual int threads() const { return Eigen::nbThreads(); }
+
+    virtual void init_matrices(const T *a, const T *b)
     {
-        a = Mat::Constant(n, n, static_cast<T>(1.0));
-        b = Mat::Constant(n, n, static_cast<T>(1.0));
-        c = Mat::Constant(n, n, static_cast<T>(0.0));
+        this->a = ConstRowMajorMap(a, this->m, this->k);
+        this->b = ConstRowMajorMap(b, this->k, this->n);
+        c = Mat::Constant(this->m, this->n, static_cast<T>(0.0));
+    }
+
+    virtual void read_result(T *c) const
+    {
+        RowMajorMap(c, this->m, this->n) = this->c;
     }
 };
+
+static const bool eigen_registered = register_gemm<EigenGEMM>("eigen");
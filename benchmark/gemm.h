@@ -1,11 +1,35 @@
 #pragma once
 
+#include <cstddef>
+#include <string>
+
+// C (m x n) = A (m x k) * B (k x n), row major
 template <class T> class GEMM
 {
   public:
+    const size_t m;
+    const size_t n;
+    const size_t k;
+
+    GEMM(size_t m, size_t n, size_t k) : m(m), n(n), k(k) {}
 
     virtual ~GEMM(){}
 
     virtual void run() = 0;
-    virtual void init_matrices() = 0;
+    // copy A (m x k) and B (k x n) in, C is zeroed
+    virtual void init_matrices(const T *a, const T *b) = 0;
+    // copy C (m x n) out
+    virtual void read_result(T *c) const = 0;
+
+    // shapes the backend cannot run are skipped
+    virtual bool supported() const { return true; }
+
+    // as in result/<name>.dat
+    virtual std::string name() const = 0;
+    // 0 if the library does not tell
+    virtual int threads() const { return 0; }
+
+    // use the B of another gemm of the same backend and shape, which must
+    // outlive this one, false if the backend cannot
+    virtual bool share_b(GEMM<T> *) { return false; }
 };
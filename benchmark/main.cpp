@@ -1,19 +1,44 @@
 #include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
+#include <condition_variable>
 #include <iostream>
+#include <limits>
+#include <mutex>
 #include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
+#include "cache.h"
+#include "perf_counters.h"
+#include "report.h"
+
+#include "registry.h"
+
+// every backend header registers its gemms, -l lists them
+#if defined(USE_AMX)
+#include "amx_gemm.h"
+#endif
 #if defined(USE_OPENBLAS)
 #include "openblas_gemm.h"
-#elif defined(USE_ACCELERATE)
+#endif
+#if defined(USE_ACCELERATE)
 #include "accelerate_gemm.h"
-#elif defined(USE_AMX)
-#include "amx_gemm.h"
-#elif defined(USE_METAL)
+#endif
+#if defined(USE_EIGEN)
+#include "eigen_gemm.h"
+#endif
+#if defined(USE_METAL)
 #include "metal_gemm.h"
 #endif
+#include "reference_gemm.h"
 
 #if defined(DTYPE_FLOAT)
 using DTYPE = float;
@@ -21,69 +46,661 @@ using DTYPE = float;
 using DTYPE = double;
 #endif
 
-template <class T> void benchmark(GEMM<T> *gemm, size_t n, int n_trials)
+struct Shape {
+    size_t m;
+    size_t n;
+    size_t k;
+};
+
+// "N" for N x N x N, or "MxNxK"
+static bool parse_shape(const std::string &text, Shape &shape)
 {
-    gemm->init_matrices();
+    unsigned long long m, n, k;
+    char rest;
+    if (std::sscanf(text.c_str(), "%llux%llux%llu%c", &m, &n, &k, &rest) ==
+        3) {
+        shape = {m, n, k};
+    } else if (std::sscanf(text.c_str(), "%llu%c", &n, &rest) == 1) {
+        shape = {n, n, n};
+    } else {
+        return false;
+    }
+    return shape.m && shape.n && shape.k;
+}
 
-    std::vector<double> timings;
-    for (int i = 0; i < n_trials; i++) {
+// one shape per line, "M N K", "MxNxK" or "N", # starts a comment
+static bool read_shapes(const char *path, std::vector<Shape> &shapes)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "cannot open " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::vector<std::string> fields;
+        for (std::string word; words >> word;) {
+            fields.push_back(word);
+        }
+        if (fields.empty()) {
+            continue;
+        }
+        Shape shape;
+        bool ok = false;
+        if (fields.size() == 3) {
+            ok = parse_shape(fields[0] + "x" + fields[1] + "x" + fields[2],
+                             shape);
+        } else if (fields.size() == 1) {
+            ok = parse_shape(fields[0], shape);
+        }
+        if (!ok) {
+            std::cerr << path << ":" << number << ": bad shape" << std::endl;
+            return false;
+        }
+        shapes.push_back(shape);
+    }
+    return true;
+}
+
+struct Options {
+    int warmup = 1;
+    int trials = 19;
+    double budget = 0; // seconds of trials per shape, after the first ones
+    std::string output; // .json or .csv
+    uint64_t seed = 1;
+    bool verify = true;
+    double verify_work = 1 << 30; // multiply-adds of the reference, 0 for all
+    double tolerance = 0;         // of the relative error, 0 for k * epsilon
+    std::vector<CacheMode> cache_modes = {CacheMode::Warm};
+    size_t flush_bytes = 64 << 20; // more than the last level cache
+    std::vector<int> workers = {1};
+    int repetitions = 1; // gemms of every worker in a trial
+    bool shared_b = false;
+    bool counters = false; // perf_event counters of every trial
+    // names of the registered backends, run one after the other on every
+    // shape
+    std::vector<std::string> backends;
+};
+
+// "amx,openblas", "all" for every registered one
+static bool parse_backends(const std::string &text,
+                           std::vector<std::string> &names)
+{
+    names.clear();
+    std::istringstream words(text);
+    for (std::string word; std::getline(words, word, ',');) {
+        if (word == "all") {
+            for (const Backend<DTYPE> &backend : backends<DTYPE>()) {
+                names.push_back(backend.name);
+            }
+        } else if (find_backend<DTYPE>(word)) {
+            names.push_back(word);
+        } else {
+            std::cerr << "unknown backend " << word << std::endl;
+            return false;
+        }
+    }
+    return !names.empty();
+}
+
+// copies of a shape for CacheMode::Rotate, larger than the flush buffer
+// together
+static size_t rotate_copies(const Shape &shape, size_t flush_bytes)
+{
+    size_t bytes =
+        (shape.m * shape.k + shape.k * shape.n + shape.m * shape.n) *
+        sizeof(DTYPE);
+    return std::min<size_t>(1024, flush_bytes / bytes + 2);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double>>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+// one trial: every worker runs repetitions gemms on its copy, all starting
+// together. returns the wall time, spans are from the start of the trial
+template <class T>
+double run_trial(const std::vector<std::vector<GEMM<T> *>> &gemms,
+                 size_t copy, int repetitions, std::vector<Span> &spans)
+{
+    spans.assign(gemms.size(), Span());
+    std::chrono::steady_clock::time_point start;
+    if (gemms.size() == 1) {
+        GEMM<T> *gemm = gemms[0][copy % gemms[0].size()];
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repetitions; r++) {
+            gemm->run();
+        }
+        spans[0].end = seconds_since(start);
+        return spans[0].end;
+    }
+
+    std::mutex lock;
+    std::condition_variable ready;
+    bool go = false;
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < gemms.size(); w++) {
+        threads.emplace_back([&, w] {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                ready.wait(guard, [&] { return go; });
+            }
+            GEMM<T> *gemm = gemms[w][copy % gemms[w].size()];
+            spans[w].start = seconds_since(start);
+            for (int r = 0; r < repetitions; r++) {
+                gemm->run();
+            }
+            spans[w].end = seconds_since(start);
+        });
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        start = std::chrono::steady_clock::now();
+        go = true;
+    }
+    ready.notify_all();
+    double wall = 0;
+    for (size_t w = 0; w < threads.size(); w++) {
+        threads[w].join();
+        wall = std::max(wall, spans[w].end);
+    }
+    return wall;
+}
+
+// warmup trials, then options.trials trials, then more until options.budget
+// seconds are spent. gemms has the copies of one shape of every worker,
+// trials go round them (one copy but for CacheMode::Rotate). flusher is used
+// by CacheMode::Cold, perf counts every trial if not null
+template <class T>
+Result benchmark(const std::vector<std::vector<GEMM<T> *>> &gemms,
+                 CacheMode mode, CacheFlusher *flusher, PerfCounters *perf,
+                 const Options &options)
+{
+    GEMM<T> *gemm = gemms[0][0];
+    std::vector<T> a, b;
+    random_matrix(a, gemm->m * gemm->k, options.seed);
+    random_matrix(b, gemm->k * gemm->n, options.seed ^ 0x9e3779b97f4a7c15ull);
+    for (const std::vector<GEMM<T> *> &copies : gemms) {
+        for (GEMM<T> *copy : copies) {
+            copy->init_matrices(a.data(), b.data());
+        }
+    }
 
-        const std::chrono::steady_clock::time_point start =
-            std::chrono::steady_clock::now();
+    std::vector<Span> spans;
+    size_t next = 0;
+    for (int i = 0; i < options.warmup; i++) {
+        run_trial(gemms, next++, options.repetitions, spans);
+    }
 
-        gemm->run();
+    std::vector<double> timings;
+    std::vector<std::vector<Span>> timelines;
+    std::vector<double> counts[COUNTERS];
+    double spent = 0;
+    while (timings.size() < static_cast<size_t>(options.trials) ||
+           (spent < options.budget && timings.size() < 100000)) {
+        if (mode == CacheMode::Cold) {
+            flusher->flush();
+        }
+        if (perf) {
+            perf->start();
+        }
+        timings.push_back(
+            run_trial(gemms, next++, options.repetitions, spans));
+        if (perf) {
+            CounterValues values = perf->stop();
+            for (int c = 0; c < COUNTERS; c++) {
+                if (!std::isnan(values.value[c])) {
+                    counts[c].push_back(values.value[c]);
+                }
+            }
+        }
+        timelines.push_back(spans);
+        spent += timings.back();
+    }
 
-        const std::chrono::steady_clock::time_point end =
-            std::chrono::steady_clock::now();
+    Result result;
+    result.backend = gemm->name();
+    result.dtype = std::is_same<T, float>::value ? "float" : "double";
+    result.threads = gemm->threads();
+    result.workers = static_cast<int>(gemms.size());
+    result.repetitions = options.repetitions;
+    result.shared_b = options.shared_b;
+    result.m = gemm->m;
+    result.n = gemm->n;
+    result.k = gemm->k;
+    result.warmup = options.warmup;
+    result.cache = cache_mode_name(mode);
+    result.timings = timings;
+    result.stats = compute_stats(timings);
+    result.seed = options.seed;
+    // the trial closest to the median
+    size_t median = 0;
+    for (size_t t = 1; t < timings.size(); t++) {
+        if (std::fabs(timings[t] - result.stats.median) <
+            std::fabs(timings[median] - result.stats.median)) {
+            median = t;
+        }
+    }
+    result.timeline = timelines[median];
+    for (int c = 0; c < COUNTERS; c++) {
+        if (!counts[c].empty()) {
+            result.counters.value[c] = compute_stats(counts[c]).median;
+        }
+    }
 
-        if (i < 1) continue;
+    // C of the last trial, so that kernels must not depend on a zeroed C.
+    // every worker must have the C of the first one
+    if (options.verify) {
+        size_t last = next - 1;
+        std::vector<T> c(gemm->m * gemm->n), other(gemm->m * gemm->n);
+        gemms[0][last % gemms[0].size()]->read_result(c.data());
+        double work = options.verify_work > 0
+                          ? options.verify_work
+                          : std::numeric_limits<double>::infinity();
+        result.verification = verify(a.data(), b.data(), c.data(), gemm->m,
+                                     gemm->n, gemm->k, work, options.tolerance);
+        for (size_t w = 1; w < gemms.size(); w++) {
+            gemms[w][last % gemms[w].size()]->read_result(other.data());
+            if (other != c) {
+                result.verification.passed = false;
+                result.verification.worker_mismatch = true;
+            }
+        }
+    }
+    return result;
+}
 
-        double runtime =
-            std::chrono::duration_cast<std::chrono::duration<double>>(end -
-                                                                      start)
-                .count();
-        timings.push_back(runtime);
+// GFLOP/s of the min runtime, like result/*.dat, and of the median after it.
+// M and K come after the columns of result/*.dat, so that N is the first
+// column of square sweeps
+static void print_header()
+{
+    std::cout << std::left << std::setw(8) << "N" << std::setw(12)
+              << "GFLOP/s" << std::setw(12) << "mean(rt)" << std::setw(12)
+              << "min(rt)" << std::setw(12) << "max(rt)" << std::setw(8)
+              << "M" << std::setw(8) << "K" << std::setw(12) << "median(rt)"
+              << std::setw(12) << "GFLOP/s(md)" << std::setw(12) << "p5(rt)"
+              << std::setw(12) << "p95(rt)" << std::setw(12) << "p99(rt)"
+              << std::setw(8) << "cv" << std::setw(10) << "outliers"
+              << std::setw(12) << "abs(err)" << std::setw(12) << "rel(err)"
+              << std::setw(8) << "cache" << std::setw(9) << "workers"
+              << "backend" << std::endl;
+}
+
+static void print_result(const Result &result)
+{
+    const Stats &s = result.stats;
+    std::cout << std::fixed << std::left << std::setw(8) << result.n
+              << std::setw(12) << std::setprecision(3) << result.peak_gflops()
+              << std::setprecision(5) << std::setw(12) << s.mean
+              << std::setw(12) << s.min << std::setw(12) << s.max
+              << std::setw(8) << result.m << std::setw(8) << result.k
+              << std::setw(12) << s.median << std::setprecision(3)
+              << std::setw(12) << result.gflops() << std::setprecision(5)
+              << std::setw(12) << s.p5
+              << std::setw(12) << s.p95 << std::setw(12) << s.p99
+              << std::setprecision(3) << std::setw(8) << s.cv << std::setw(10)
+              << s.outliers << std::scientific << std::setprecision(2);
+    const Verification &v = result.verification;
+    if (v.rows) {
+        std::cout << std::setw(12) << v.max_abs_error << std::setw(12)
+                  << v.max_rel_error;
+    } else {
+        std::cout << std::setw(12) << "-" << std::setw(12) << "-";
+    }
+    std::cout << std::setw(8) << result.cache << std::setw(9) << result.workers
+              << result.backend << std::endl;
+    if (v.worker_mismatch) {
+        std::cerr << "FAILED: " << result.backend << " " << result.m << "x"
+                  << result.n << "x" << result.k
+                  << " gives different results in " << result.workers
+                  << " threads" << std::endl;
+    } else if (!v.passed) {
+        std::cerr << "FAILED: " << result.backend << " " << result.m << "x"
+                  << result.n << "x" << result.k << " has a relative error of "
+                  << v.max_rel_error << " over " << v.tolerance << " in "
+                  << v.rows << " rows" << std::endl;
+    }
+    // median counts of the trials per FLOP, and per trial for the page faults
+    if (result.counters.any()) {
+        const double *value = result.counters.value;
+        std::ostringstream line;
+        line << std::setprecision(3);
+        for (int c = 0; c < COUNTERS; c++) {
+            if (std::isnan(value[c])) {
+                continue;
+            }
+            line << (line.tellp() > 0 ? ", " : "") << counter_name(c);
+            if (c == COUNTER_PAGE_FAULTS) {
+                line << " " << value[c];
+            } else {
+                line << "/FLOP " << value[c] / result.flops();
+            }
+        }
+        if (!std::isnan(value[COUNTER_CYCLES]) &&
+            !std::isnan(value[COUNTER_INSTRUCTIONS])) {
+            line << ", IPC "
+                 << value[COUNTER_INSTRUCTIONS] / value[COUNTER_CYCLES];
+        }
+        std::cout << "# " << result.m << "x" << result.n << "x" << result.k
+                  << " " << result.backend << " " << result.cache << ": "
+                  << line.str() << std::endl;
+    }
+    // when every worker started and finished, in ms
+    if (result.workers > 1) {
+        for (int w = 0; w < result.workers; w++) {
+            std::cout << "# thread " << w << ": " << std::fixed
+                      << std::setprecision(3)
+                      << result.timeline[w].start * 1e3 << " - "
+                      << result.timeline[w].end * 1e3 << " ms" << std::endl;
+        }
     }
+    if (s.cv > 0.05) {
+        std::cerr << "noisy: " << result.backend << " " << result.m << "x"
+                  << result.n << "x" << result.k << " has a cv of " << s.cv
+                  << ", " << s.outliers << " outliers in " << s.count
+                  << " trials" << std::endl;
+    }
+}
 
-    double min_rt = *std::min_element(timings.begin(), timings.end());
-    double max_rt = *std::max_element(timings.begin(), timings.end());
-    double mean_rt =
-        std::accumulate(timings.begin(), timings.end(), 0.0) / timings.size();
-    double gflops = (2 * n * n * n / min_rt / 1e9);
+static bool write_results(const std::string &path,
+                          const std::vector<Result> &results)
+{
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "cannot write " << path << std::endl;
+        return false;
+    }
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0) {
+        write_csv(file, results);
+    } else {
+        write_json(file, results);
+    }
+    return true;
+}
 
-    std::cout << std::fixed << std::left << std::setw(8) << n << std::left
-              << std::setw(12) << std::setprecision(3) << gflops << std::left
-              << std::setw(12) << std::setprecision(5) << mean_rt << std::left
-              << std::setw(12) << std::setprecision(5) << min_rt << std::left
-              << std::setw(12) << std::setprecision(5) << max_rt << std::endl;
+static void usage(const char *name)
+{
+    std::cerr << "usage: " << name
+              << " [-w warmup] [-t trials] [-b seconds] [-o out.json|out.csv]"
+                 " [-s seed] [-n | -V | -c work] [-e tolerance]"
+                 " [-m warm,cold,rotate|all] [-F flush_mb]"
+                 " [-p threads,...] [-r repetitions] [-S]"
+                 " [-B backend,...|all] [-l] [-P] [-f shapes.txt]"
+                 " [N | MxNxK]..."
+              << std::endl;
 }
 
+// usage: gemm_bench [-w warmup] [-t trials] [-b seconds]
+//                   [-o out.json|out.csv] [-s seed] [-n | -V | -c work]
+//                   [-e tolerance] [-m warm,cold,rotate|all] [-F flush_mb]
+//                   [-p threads,...] [-r repetitions] [-S]
+//                   [-B backend,...|all] [-l] [-P] [-f shapes.txt]
+//                   [N | MxNxK]...
+// without shapes, the square sweep N = 64 ... 8192
+//
+// -B runs the registered backends on every shape, on the same A and B, and
+// prints their GFLOP/s relative to the first one as # lines. -l lists them,
+// without -B the ones marked in the list run
+//
+// -P counts cycles, instructions, cache and TLB misses and page faults of
+// every trial with perf_event_open (Linux), and prints the medians per FLOP
+// as # lines. counters the host does not give are left out
+//
+// A and B are random (-s seed) and C is compared with a double reference,
+// on every row or on rows spread over C that cost at most -c multiply-adds
+// (2^30). -V checks every row, -n nothing. exits with 2 if a check fails
+//
+// -m runs every shape in each cache mode (see cache.h, warm by default) and
+// prints the change of the medians from warm as # lines. cold flushes by
+// reading -F MB (64)
+//
+// -p runs every shape with each number of threads, each thread running -r
+// gemms (1) on its own A, B and C, or on one B with -S. a trial lasts until
+// the last thread is done, GFLOP/s counts the gemms of all threads, and the
+// start and end of every thread in the median trial are printed as # lines
 int main(int argc, char *argv[])
 {
-    std::cout << std::left << std::setw(8) << "N" << std::left << std::setw(12)
-              << "GFLOP/s" << std::left << std::setw(12) << "mean(rt)"
-              << std::left << std::setw(12) << "min(rt)" << std::left
-              << std::setw(12) << "max(rt)" << std::endl;
-
-#if defined(USE_AMX) && USE_AMX <= 2
-    for (size_t i = 6; i < 13; i++) {
-#else
-    for (size_t i = 6; i < 14; i++) {
-#endif
-        size_t n = 1 << i;
+    Options options;
+    std::vector<Shape> shapes;
+    for (int i = 1; i < argc; i++) {
+        Shape shape;
+        bool value = i + 1 < argc;
+        if (std::strcmp(argv[i], "-f") == 0 && value) {
+            if (!read_shapes(argv[++i], shapes)) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "-w") == 0 && value) {
+            options.warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-t") == 0 && value) {
+            options.trials = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-b") == 0 && value) {
+            options.budget = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "-o") == 0 && value) {
+            options.output = argv[++i];
+        } else if (std::strcmp(argv[i], "-s") == 0 && value) {
+            options.seed = std::strtoull(argv[++i], NULL, 10);
+        } else if (std::strcmp(argv[i], "-n") == 0) {
+            options.verify = false;
+        } else if (std::strcmp(argv[i], "-V") == 0) {
+            options.verify_work = 0;
+        } else if (std::strcmp(argv[i], "-c") == 0 && value) {
+            options.verify_work = std::max(1.0, std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "-e") == 0 && value) {
+            options.tolerance = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "-m") == 0 && value) {
+            if (!parse_cache_modes(argv[++i], options.cache_modes)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "-p") == 0 && value) {
+            options.workers.clear();
+            std::istringstream counts(argv[++i]);
+            for (std::string count; std::getline(counts, count, ',');) {
+                options.workers.push_back(
+                    std::max(1, std::atoi(count.c_str())));
+            }
+            if (options.workers.empty()) {
+                options.workers = {1};
+            }
+        } else if (std::strcmp(argv[i], "-r") == 0 && value) {
+            options.repetitions = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-S") == 0) {
+            options.shared_b = true;
+        } else if (std::strcmp(argv[i], "-P") == 0) {
+            options.counters = true;
+        } else if (std::strcmp(argv[i], "-B") == 0 && value) {
+            if (!parse_backends(argv[++i], options.backends)) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "-l") == 0) {
+            for (const Backend<DTYPE> &backend : backends<DTYPE>()) {
+                std::cout << backend.name << (backend.by_default ? " *" : "")
+                          << std::endl;
+            }
+            return 0;
+        } else if (std::strcmp(argv[i], "-F") == 0 && value) {
+            options.flush_bytes =
+                std::max<size_t>(1, std::strtoull(argv[++i], NULL, 10)) << 20;
+        } else if (parse_shape(argv[i], shape)) {
+            shapes.push_back(shape);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    bool sweep = shapes.empty();
+    if (sweep) {
+        for (size_t i = 6; i < 14; i++) {
+            size_t n = 1 << i;
+            shapes.push_back({n, n, n});
+        }
+    }
+    if (options.backends.empty()) {
+        for (const Backend<DTYPE> &backend : backends<DTYPE>()) {
+            if (backend.by_default) {
+                options.backends.push_back(backend.name);
+            }
+        }
+    }
 
-#if defined(USE_OPENBLAS)
-        GEMM<DTYPE> *gemm = new OpenBLASGEMM<DTYPE>(n);
-#elif defined(USE_ACCELERATE)
-        GEMM<DTYPE> *gemm = new AccelerateGEMM<DTYPE>(n);
-#elif defined(USE_AMX)
-        GEMM<DTYPE> *gemm = new AMXGEMM<DTYPE>(n);
-#elif defined(USE_METAL)
-        GEMM<DTYPE> *gemm = new MetalGEMM<DTYPE>(n);
-#endif
+    PerfCounters *perf = nullptr;
+    if (options.counters) {
+        perf = new PerfCounters();
+        std::string missing;
+        for (int c = 0; c < COUNTERS; c++) {
+            if (!perf->available(c)) {
+                missing += std::string(missing.empty() ? "" : ", ") +
+                           counter_name(c);
+            }
+        }
+        if (!perf->any()) {
+            std::cerr << "no perf counters on this host, -P is ignored"
+                      << std::endl;
+            delete perf;
+            perf = nullptr;
+        } else if (!missing.empty()) {
+            std::cerr << "perf counters not available: " << missing
+                      << std::endl;
+        }
+    }
+
+    CacheFlusher *flusher = nullptr;
+    if (std::find(options.cache_modes.begin(), options.cache_modes.end(),
+                  CacheMode::Cold) != options.cache_modes.end()) {
+        flusher = new CacheFlusher(options.flush_bytes);
+    }
+
+    print_header();
+
+    std::vector<Result> results;
+    for (const Shape &shape : shapes) {
+        size_t first = results.size();
+        for (const std::string &name : options.backends) {
+            const Backend<DTYPE> *backend = find_backend<DTYPE>(name);
+            GEMM<DTYPE> *gemm = backend->make(shape.m, shape.n, shape.k);
 
-        benchmark(gemm, n, 20);
+            if (!gemm->supported()) {
+                std::cerr << "skipping " << shape.m << "x" << shape.n << "x"
+                          << shape.k << ": not supported by " << gemm->name()
+                          << std::endl;
+                delete gemm;
+                continue;
+            }
+            // kernels without packed B are too slow for 8192
+            if (sweep && shape.n > 4096 &&
+                (gemm->name() == "amx-1" || gemm->name() == "amx-2")) {
+                delete gemm;
+                continue;
+            }
 
-        delete gemm;
+            for (CacheMode mode : options.cache_modes) {
+                for (int workers : options.workers) {
+                    // gemms[w]: the copies of worker w, gemm is the first one
+                    size_t copies = 1;
+                    if (mode == CacheMode::Rotate) {
+                        copies = std::max<size_t>(
+                            2, rotate_copies(shape, options.flush_bytes) /
+                                   workers);
+                    }
+                    Options run = options;
+                    std::vector<std::vector<GEMM<DTYPE> *>> gemms(workers);
+                    for (int w = 0; w < workers; w++) {
+                        for (size_t c = 0; c < copies; c++) {
+                            GEMM<DTYPE> *copy =
+                                w == 0 && c == 0
+                                    ? gemm
+                                    : backend->make(shape.m, shape.n, shape.k);
+                            if (copy != gemm && run.shared_b &&
+                                !copy->share_b(gemm)) {
+                                std::cerr << gemm->name()
+                                          << " cannot share B, every copy has"
+                                             " its own"
+                                          << std::endl;
+                                run.shared_b = false;
+                            }
+                            gemms[w].push_back(copy);
+                        }
+                    }
+                    results.push_back(
+                        benchmark(gemms, mode, flusher, perf, run));
+                    print_result(results.back());
+                    // copies sharing the B of gemm go first
+                    for (int w = workers - 1; w >= 0; w--) {
+                        for (size_t c = gemms[w].size(); c-- > 0;) {
+                            if (gemms[w][c] != gemm) {
+                                delete gemms[w][c];
+                            }
+                        }
+                    }
+                }
+            }
+            delete gemm;
+        }
+
+        // of the same backend: the change from warm and the speedup over one
+        // worker of the same cache mode. of the same run: the GFLOP/s over
+        // the first backend
+        for (size_t r = first; r < results.size(); r++) {
+            const Result &result = results[r];
+            for (size_t o = first; o < results.size(); o++) {
+                const Result &other = results[o];
+                if (other.backend != result.backend) {
+                    if (other.backend == results[first].backend &&
+                        other.cache == result.cache &&
+                        other.workers == result.workers) {
+                        std::cout << "# " << shape.m << "x" << shape.n << "x"
+                                  << shape.k << " " << result.cache << " ";
+                        if (result.workers > 1) {
+                            std::cout << result.workers << " threads ";
+                        }
+                        std::cout << result.backend << ": " << std::fixed
+                                  << std::setprecision(2)
+                                  << result.gflops() / other.gflops()
+                                  << "x the GFLOP/s of " << other.backend
+                                  << std::endl;
+                    }
+                    continue;
+                }
+                if (other.workers == result.workers &&
+                    other.cache == "warm" && result.cache != "warm") {
+                    std::cout << "# " << shape.m << "x" << shape.n << "x"
+                              << shape.k << " " << result.backend << " "
+                              << result.cache << " median vs warm: "
+                              << std::fixed << std::setprecision(1)
+                              << std::showpos
+                              << 100 * (result.stats.median /
+                                            other.stats.median -
+                                        1)
+                              << std::noshowpos << "%" << std::endl;
+                }
+                if (other.workers == 1 && result.workers > 1 &&
+                    other.cache == result.cache) {
+                    std::cout << "# " << shape.m << "x" << shape.n << "x"
+                              << shape.k << " " << result.backend << " "
+                              << result.cache << " " << result.workers
+                              << " threads: " << std::fixed
+                              << std::setprecision(2)
+                              << result.gflops() / other.gflops()
+                              << "x the GFLOP/s of 1" << std::endl;
+                }
+            }
+        }
+    }
+    delete flusher;
+    delete perf;
+
+    if (!options.output.empty() && !write_results(options.output, results)) {
+        return 1;
+    }
+    for (const Result &result : results) {
+        if (!result.verification.passed) {
+            return 2;
+        }
     }
 }
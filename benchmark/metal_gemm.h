@@ -2,12 +2,14 @@
 #import <Metal/Metal.h>
 #import <MetalPerformanceShaders/MetalPerformanceShaders.h>
 
+#include <algorithm>
+
 #import "gemm.h"
+#import "registry.h"
 
 template <class T> class MetalGEMM : public GEMM<T>
 {
 protected:
-    size_t n;
     id<MTLDevice> device;
     id<MTLCommandQueue> commandQueue;
     MPSMatrixDescriptor *descA;
@@ -22,32 +24,32 @@ protected:
     MPSMatrixMultiplication *kernel;
 
 public:
-    MetalGEMM(size_t n) : n(n)
+    MetalGEMM(size_t m, size_t n, size_t k) : GEMM<T>(m, n, k)
     {
         device = MTLCreateSystemDefaultDevice();
         commandQueue = [device newCommandQueue];
 
         descA =
-            [MPSMatrixDescriptor matrixDescriptorWithRows:n
-                                                  columns:n
-                                                 rowBytes:sizeof(float) * n
+            [MPSMatrixDescriptor matrixDescriptorWithRows:m
+                                                  columns:k
+                                                 rowBytes:sizeof(float) * k
                                                  dataType:MPSDataTypeFloat32];
         descB =
-            [MPSMatrixDescriptor matrixDescriptorWithRows:n
+            [MPSMatrixDescriptor matrixDescriptorWithRows:k
                                                   columns:n
                                                  rowBytes:sizeof(float) * n
                                                  dataType:MPSDataTypeFloat32];
         descC =
-            [MPSMatrixDescriptor matrixDescriptorWithRows:n
+            [MPSMatrixDescriptor matrixDescriptorWithRows:m
                                                   columns:n
                                                  rowBytes:sizeof(float) * n
                                                  dataType:MPSDataTypeFloat32];
 
         bufferA = [device newBufferWithLength:[descA matrixBytes]
                                       options:MTLResourceStorageModeShared];
-        bufferB = [device newBufferWithLength:[descA matrixBytes]
+        bufferB = [device newBufferWithLength:[descB matrixBytes]
                                       options:MTLResourceStorageModeShared];
-        bufferC = [device newBufferWithLength:[descA matrixBytes]
+        bufferC = [device newBufferWithLength:[descC matrixBytes]
                                       options:MTLResourceStorageModeShared];
 
         matA = [[MPSMatrix alloc] initWithBuffer:bufferA descriptor:descA];
@@ -57,9 +59,9 @@ public:
         kernel = [[MPSMatrixMultiplication alloc] initWithDevice:device
                                                    transposeLeft:false
                                                   transposeRight:false
-                                                      resultRows:n
+                                                      resultRows:m
                                                    resultColumns:n
-                                                 interiorColumns:n
+                                                 interiorColumns:k
                                                            alpha:1.0
                                                             beta:0.0];
     }
@@ -80,18 +82,28 @@ public:
         [commandBuffer release];
     }
 
-    virtual void init_matrices()
+    virtual std::string name() const { return "metal"; }
+
+    virtual void init_matrices(const T *a, const T *b)
     {
-        float *a = static_cast<float *>([bufferA contents]);
-        float *b = static_cast<float *>([bufferB contents]);
-        float *c = static_cast<float *>([bufferC contents]);
-
-        for (int i = 0; i < n; i++) {
-            for (int j = 0; j < n; j++) {
-                a[i * n + j] = static_cast<T>(1.0);
-                b[i * n + j] = static_cast<T>(1.0);
-                c[i * n + j] = static_cast<T>(0.0);
-            }
-        }
+        float *a0 = static_cast<float *>([bufferA contents]);
+        float *b0 = static_cast<float *>([bufferB contents]);
+        float *c0 = static_cast<float *>([bufferC contents]);
+
+        std::copy(a, a + this->m * this->k, a0);
+        std::copy(b, b + this->k * this->n, b0);
+        std::fill(c0, c0 + this->m * this->n, 0.0f);
+    }
+
+    virtual void read_result(T *c) const
+    {
+        const float *c0 = static_cast<const float *>([bufferC contents]);
+        std::copy(c0, c0 + this->m * this->n, c);
     }
 };
+
+// the buffers are float
+static const bool metal_registered = register_backend<float>(
+    "metal", [](size_t m, size_t n, size_t k) -> GEMM<float> * {
+        return new MetalGEMM<float>(m, n, k);
+    });
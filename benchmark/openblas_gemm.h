@@ -1,53 +1,80 @@
 #pragma once
 
 #include <cblas.h>
+#include <algorithm>
 #include <type_traits>
 
 #include "gemm.h"
+#include "registry.h"
 
 template <class T> class OpenBLASGEMM : public GEMM<T>
 {
 protected:
-    size_t n;
     T *a;
     T *b;
     T *c;
+    bool own_b = true;
 
 public:
-    OpenBLASGEMM(size_t n)
-        : n(n), a(new (std::align_val_t{64}) T[n * n]),
-          b(new (std::align_val_t{64}) T[n * n]),
-          c(new (std::align_val_t{64}) T[n * n])
+    OpenBLASGEMM(size_t m, size_t n, size_t k)
+        : GEMM<T>(m, n, k), a(new (std::align_val_t{64}) T[m * k]),
+          b(new (std::align_val_t{64}) T[k * n]),
+          c(new (std::align_val_t{64}) T[m * n])
     {
     }
 
     ~OpenBLASGEMM()
     {
         delete[] a;
-        delete[] b;
+        if (own_b) {
+            delete[] b;
+        }
         delete[] c;
     }
 
     virtual void run()
     {
         if constexpr (std::is_same<T, float>::value) {
-            cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, n, n, n, 1.0,
-                        a, n, b, n, 0.0, c, n);
+            cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, this->m,
+                        this->n, this->k, 1.0, a, this->k, b, this->n, 0.0, c,
+                        this->n);
         } else if (std::is_same<T, double>::value) {
-            cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, n, n, n, 1.0,
-                        a, n, b, n, 0.0, c, n);
+            cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, this->m,
+                        this->n, this->k, 1.0, a, this->k, b, this->n, 0.0, c,
+                        this->n);
         } else {
         }
     }
 
-    virtual void init_matrices()
+    virtual std::string name() const { return "openblas"; }
+
+    virtual int threads() const { return openblas_get_num_threads(); }
+
+    virtual bool share_b(GEMM<T> *owner)
     {
-        for (int i = 0; i < n; i++) {
-            for (int j = 0; j < n; j++) {
-                a[i * n + j] = static_cast<T>(1.0);
-                b[i * n + j] = static_cast<T>(1.0);
-                c[i * n + j] = static_cast<T>(0.0);
-            }
+        OpenBLASGEMM *other = dynamic_cast<OpenBLASGEMM *>(owner);
+        if (other == nullptr || other->k != this->k || other->n != this->n) {
+            return false;
         }
+        if (own_b) {
+            delete[] b;
+        }
+        b = other->b;
+        own_b = false;
+        return true;
+    }
+
+    virtual void init_matrices(const T *a, const T *b)
+    {
+        std::copy(a, a + this->m * this->k, this->a);
+        std::copy(b, b + this->k * this->n, this->b);
+        std::fill(c, c + this->m * this->n, static_cast<T>(0.0));
+    }
+
+    virtual void read_result(T *c) const
+    {
+        std::copy(this->c, this->c + this->m * this->n, c);
     }
 };
+
+static const bool openblas_registered = register_gemm<OpenBLASGEMM>("openblas");
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// counters of the trials, nan when the host does not have them
+enum Counter {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES, // last level
+    COUNTER_TLB_MISSES,   // data loads
+    COUNTER_PAGE_FAULTS,
+    COUNTERS
+};
+
+inline const char *counter_name(int counter)
+{
+    static const char *names[COUNTERS] = {"cycles", "instructions",
+                                          "cache_misses", "tlb_misses",
+                                          "page_faults"};
+    return names[counter];
+}
+
+struct CounterValues {
+    double value[COUNTERS];
+
+    CounterValues()
+    {
+        for (int c = 0; c < COUNTERS; c++) {
+            value[c] = std::numeric_limits<double>::quiet_NaN();
+        }
+    }
+
+    bool any() const
+    {
+        for (int c = 0; c < COUNTERS; c++) {
+            if (!std::isnan(value[c])) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// perf_event_open counters of this process and the threads it starts later,
+// user space only, so that perf_event_paranoid 2 allows them. the hardware
+// events are one group, scheduled together, the page faults another. events
+// the kernel, the cpu or the container refuse are left out
+class PerfCounters
+{
+#if defined(__linux__)
+    int fd[COUNTERS];
+    std::vector<int> leaders;
+
+    static int open_event(uint32_t type, uint64_t config, int group)
+    {
+        perf_event_attr attr = {};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = group == -1;
+        attr.inherit = 1; // the worker threads
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format =
+            PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(
+            syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+    }
+
+    void open_group(const std::vector<int> &counters,
+                    const std::vector<std::pair<uint32_t, uint64_t>> &events)
+    {
+        int leader = -1;
+        for (size_t e = 0; e < counters.size(); e++) {
+            fd[counters[e]] =
+                open_event(events[e].first, events[e].second, leader);
+            if (fd[counters[e]] >= 0 && leader == -1) {
+                leader = fd[counters[e]];
+                leaders.push_back(leader);
+            }
+        }
+    }
+
+  public:
+    PerfCounters()
+    {
+        for (int c = 0; c < COUNTERS; c++) {
+            fd[c] = -1;
+        }
+        open_group(
+            {COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_CACHE_MISSES,
+             COUNTER_TLB_MISSES},
+            {{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+             {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+             {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+             {PERF_TYPE_HW_CACHE,
+              PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                  PERF_COUNT_HW_CACHE_RESULT_MISS << 16}});
+        open_group({COUNTER_PAGE_FAULTS},
+                   {{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}});
+    }
+
+    ~PerfCounters()
+    {
+        for (int c = 0; c < COUNTERS; c++) {
+            if (fd[c] >= 0) {
+                close(fd[c]);
+            }
+        }
+    }
+
+    bool available(int counter) const { return fd[counter] >= 0; }
+
+    void start()
+    {
+        for (int leader : leaders) {
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    // counts since start, scaled up when the events were multiplexed
+    CounterValues stop()
+    {
+        for (int leader : leaders) {
+            ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        }
+        CounterValues values;
+        for (int c = 0; c < COUNTERS; c++) {
+            uint64_t data[3]; // value, time enabled, time running
+            if (fd[c] < 0 || read(fd[c], data, sizeof(data)) !=
+                                 static_cast<ssize_t>(sizeof(data))) {
+                continue;
+            }
+            if (data[2] == 0) {
+                continue; // never scheduled
+            }
+            values.value[c] = static_cast<double>(data[0]);
+            if (data[2] < data[1]) {
+                values.value[c] *= static_cast<double>(data[1]) / data[2];
+            }
+        }
+        return values;
+    }
+#else
+  public:
+    bool available(int) const { return false; }
+    void start() {}
+    CounterValues stop() { return CounterValues(); }
+#endif
+
+    bool any() const
+    {
+        for (int c = 0; c < COUNTERS; c++) {
+            if (available(c)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
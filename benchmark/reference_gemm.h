@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "gemm.h"
+#include "registry.h"
+#include "verify.h"
+
+// the double precision reference of verify.h rounded to T: slow, but it
+// builds on every host and checks the harness and the other backends
+template <class T> class ReferenceGEMM : public GEMM<T>
+{
+protected:
+    std::vector<T> a;
+    std::vector<T> b;
+    std::vector<T> c;
+    std::vector<double> row;
+    std::vector<double> scale;
+
+public:
+    ReferenceGEMM(size_t m, size_t n, size_t k)
+        : GEMM<T>(m, n, k), a(m * k), b(k * n), c(m * n), row(n), scale(n)
+    {
+    }
+
+    virtual void run()
+    {
+        for (size_t i = 0; i < this->m; i++) {
+            reference_row(a.data(), b.data(), this->n, this->k, i, row.data(),
+                          scale.data());
+            std::copy(row.begin(), row.end(), c.begin() + i * this->n);
+        }
+    }
+
+    // minutes per shape past 1024^3 multiply-adds
+    virtual bool supported() const
+    {
+        return static_cast<double>(this->m) * this->n * this->k <=
+               static_cast<double>(1 << 30);
+    }
+
+    virtual std::string name() const { return "reference"; }
+
+    virtual int threads() const { return 1; }
+
+    virtual void init_matrices(const T *a, const T *b)
+    {
+        std::copy(a, a + this->m * this->k, this->a.begin());
+        std::copy(b, b + this->k * this->n, this->b.begin());
+        std::fill(c.begin(), c.end(), static_cast<T>(0.0));
+    }
+
+    virtual void read_result(T *c) const
+    {
+        std::copy(this->c.begin(), this->c.end(), c);
+    }
+};
+
+static const bool reference_registered =
+    register_gemm<ReferenceGEMM>("reference", false);
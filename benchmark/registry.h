@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "gemm.h"
+
+// a backend compiled into gemm_bench, -B picks them by name
+template <class T> struct Backend {
+    std::string name;
+    std::function<GEMM<T> *(size_t m, size_t n, size_t k)> make;
+    bool by_default; // run when -B is not given
+};
+
+// in the order the backend headers are included
+template <class T> std::vector<Backend<T>> &backends()
+{
+    static std::vector<Backend<T>> registered;
+    return registered;
+}
+
+template <class T>
+bool register_backend(const std::string &name,
+                      std::function<GEMM<T> *(size_t, size_t, size_t)> make,
+                      bool by_default = true)
+{
+    backends<T>().push_back({name, make, by_default});
+    return true;
+}
+
+// G<float> and G<double> under one name, for backend headers:
+//   static const bool registered = register_gemm<MyGEMM>("mine");
+template <template <class> class G>
+bool register_gemm(const std::string &name, bool by_default = true)
+{
+    register_backend<float>(
+        name,
+        [](size_t m, size_t n, size_t k) -> GEMM<float> * {
+            return new G<float>(m, n, k);
+        },
+        by_default);
+    return register_backend<double>(
+        name,
+        [](size_t m, size_t n, size_t k) -> GEMM<double> * {
+            return new G<double>(m, n, k);
+        },
+        by_default);
+}
+
+template <class T> const Backend<T> *find_backend(const std::string &name)
+{
+    for (const Backend<T> &backend : backends<T>()) {
+        if (backend.name == name) {
+            return &backend;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "perf_counters.h"
+#include "stats.h"
+#include "verify.h"
+
+// work of one thread of the harness in a trial, seconds from its start
+struct Span {
+    double start = 0;
+    double end = 0;
+};
+
+// one shape of one backend
+struct Result {
+    std::string backend;
+    std::string dtype;
+    int threads; // of the library, 0 if the backend does not tell
+    int workers; // threads of the harness, each running its own gemms
+    int repetitions;
+    bool shared_b; // one B for all workers
+    size_t m;
+    size_t n;
+    size_t k;
+    int warmup;
+    std::string cache; // warm, cold or rotate
+    std::vector<double> timings; // seconds, in run order
+    Stats stats;
+    uint64_t seed;
+    Verification verification; // rows 0 if not verified
+    std::vector<Span> timeline; // of the trial closest to the median
+    CounterValues counters;     // medians of the trials, nan if not counted
+
+    // of a trial: every gemm of every worker
+    double flops() const { return 2.0 * m * n * k * workers * repetitions; }
+    // of the median and of the fastest trial
+    double gflops() const { return flops() / stats.median / 1e9; }
+    double peak_gflops() const { return flops() / stats.min / 1e9; }
+};
+
+inline std::string json_string(const std::string &text)
+{
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+// nan and inf are not json
+inline std::string json_number(double value)
+{
+    if (!std::isfinite(value)) {
+        return "null";
+    }
+    std::ostringstream out;
+    out << std::setprecision(9) << value;
+    return out.str();
+}
+
+inline void write_json(std::ostream &out, const std::vector<Result> &results)
+{
+    out << std::setprecision(9) << "[\n";
+    for (size_t r = 0; r < results.size(); r++) {
+        const Result &result = results[r];
+        const Stats &s = result.stats;
+        const Verification &v = result.verification;
+        out << "  {\"backend\": " << json_string(result.backend)
+            << ", \"dtype\": " << json_string(result.dtype)
+            << ", \"threads\": " << result.threads
+            << ", \"workers\": " << result.workers
+            << ", \"repetitions\": " << result.repetitions
+            << ", \"shared_b\": " << (result.shared_b ? "true" : "false")
+            << ", \"m\": " << result.m
+            << ", \"n\": " << result.n << ", \"k\": " << result.k
+            << ", \"warmup\": " << result.warmup
+            << ", \"cache\": " << json_string(result.cache)
+            << ", \"trials\": " << s.count
+            << ",\n   \"gflops\": " << result.gflops()
+            << ", \"peak_gflops\": " << result.peak_gflops()
+            << ", \"median\": " << s.median << ", \"mean\": " << s.mean
+            << ", \"min\": " << s.min << ", \"max\": " << s.max
+            << ", \"p5\": " << s.p5 << ", \"p95\": " << s.p95
+            << ", \"p99\": " << s.p99 << ", \"stddev\": " << s.stddev
+            << ", \"cv\": " << s.cv << ", \"outliers\": " << s.outliers
+            << ",\n   \"seed\": " << result.seed
+            << ", \"verified_rows\": " << v.rows
+            << ", \"max_abs_error\": " << json_number(v.max_abs_error)
+            << ", \"max_rel_error\": " << json_number(v.max_rel_error)
+            << ", \"tolerance\": " << v.tolerance
+            << ", \"passed\": " << (v.passed ? "true" : "false")
+            << ", \"worker_mismatch\": "
+            << (v.worker_mismatch ? "true" : "false")
+            << ",\n   \"timeline\": [";
+        for (size_t w = 0; w < result.timeline.size(); w++) {
+            out << (w ? ", " : "") << "[" << result.timeline[w].start << ", "
+                << result.timeline[w].end << "]";
+        }
+        out << "],\n   \"counters\": {";
+        for (int c = 0; c < COUNTERS; c++) {
+            out << (c ? ", " : "") << json_string(counter_name(c)) << ": "
+                << json_number(result.counters.value[c]);
+        }
+        out << "},\n   \"timings\": [";
+        for (size_t t = 0; t < result.timings.size(); t++) {
+            out << (t ? ", " : "") << result.timings[t];
+        }
+        out << "]}" << (r + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+inline void write_csv(std::ostream &out, const std::vector<Result> &results)
+{
+    out << std::setprecision(9)
+        << "backend,dtype,threads,workers,repetitions,shared_b,m,n,k,"
+           "warmup,cache,trials,gflops,peak_gflops,median,mean,min,max,p5,"
+           "p95,p99,stddev,cv,outliers,seed,"
+           "verified_rows,max_abs_error,max_rel_error,tolerance,passed,"
+           "worker_mismatch";
+    for (int c = 0; c < COUNTERS; c++) {
+        out << "," << counter_name(c);
+    }
+    out << "\n";
+    for (const Result &result : results) {
+        const Stats &s = result.stats;
+        const Verification &v = result.verification;
+        out << result.backend << "," << result.dtype << "," << result.threads
+            << "," << result.workers << "," << result.repetitions << ","
+            << (result.shared_b ? 1 : 0) << "," << result.m << ","
+            << result.n << "," << result.k << "," << result.warmup << ","
+            << result.cache << "," << s.count << "," << result.gflops()
+            << "," << result.peak_gflops() << "," << s.median << ","
+            << s.mean << "," << s.min << "," << s.max << "," << s.p5 << ","
+            << s.p95 << "," << s.p99 << "," << s.stddev << "," << s.cv << ","
+            << s.outliers << "," << result.seed << "," << v.rows << ","
+            << v.max_abs_error << "," << v.max_rel_error << ","
+            << v.tolerance << "," << (v.passed ? 1 : 0) << ","
+            << (v.worker_mismatch ? 1 : 0);
+        // empty if not counted
+        for (int c = 0; c < COUNTERS; c++) {
+            out << ",";
+            if (!std::isnan(result.counters.value[c])) {
+                out << result.counters.value[c];
+            }
+        }
+        out << "\n";
+    }
+}
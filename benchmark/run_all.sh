@@ -2,39 +2,26 @@
 
 mkdir -p result
 
-echo "Benchmarking with Accelerate"
-mkdir -p build-accelerate
-pushd build-accelerate
-cmake -DDTYPE=FLOAT -DBACKEND=Accelerate -DCMAKE_BUILD_TYPE=Release ..
+# AMX, Accelerate and Metal in one binary, the AMX kernels on the same data
+echo "Benchmarking with AMX, Accelerate and Metal"
+mkdir -p build
+pushd build
+cmake -DDTYPE=FLOAT -DWITH_AMX=ON -DWITH_ACCELERATE=ON -DWITH_METAL=ON -DCMAKE_BUILD_TYPE=Release ..
 make
-./gemm_bench > ../result/accelerate.dat
+for backend in accelerate metal amx amx-1 amx-2 amx-3
+do
+	echo "Benchmarking with $backend"
+	./gemm_bench -B $backend > ../result/$backend.dat
+done
 popd
 
+# OpenBLAS has the cblas symbols of Accelerate, so it gets its own binary
 echo "Benchmarking with OpenBLAS"
 mkdir -p build-openblas
 pushd build-openblas
-LDFLAGS=-L$(brew --prefix openblas)/lib cmake -DDTYPE=FLOAT -DBACKEND=OpenBLAS -DCMAKE_BUILD_TYPE=Release ..
+LDFLAGS=-L$(brew --prefix openblas)/lib cmake -DDTYPE=FLOAT -DWITH_AMX=OFF -DWITH_ACCELERATE=OFF -DWITH_OPENBLAS=ON -DCMAKE_BUILD_TYPE=Release ..
 CPATH=$(brew --prefix openblas)/include make
-./gemm_bench > ../result/openblas.dat
-popd
-
-for i in 1 2 3
-do
-	echo "Benchmarking with AMX $i"
-	mkdir -p build-amx-$i
-	pushd build-amx-$i
-	cmake -DDTYPE=FLOAT -DBACKEND=AMX_$i -DCMAKE_BUILD_TYPE=Release ..
-	make
-	./gemm_bench > ../result/amx-$i.dat
-	popd
-done
-
-echo "Benchmarking with Metal"
-mkdir -p build-metal
-pushd build-metal
-cmake -DDTYPE=FLOAT -DBACKEND=Metal -DCMAKE_BUILD_TYPE=Release ..
-make
-./gemm_bench > ../result/metal.dat
+./gemm_bench -B openblas > ../result/openblas.dat
 popd
 
 pushd result
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+// summary of the runtimes (seconds) of the trials of one shape
+struct Stats {
+    size_t count = 0;
+    double min = 0;
+    double max = 0;
+    double mean = 0;
+    double stddev = 0;
+    double cv = 0; // stddev / mean
+    double median = 0;
+    double p5 = 0;
+    double p95 = 0;
+    double p99 = 0;
+    // outside the Tukey fences, 1.5 interquartile ranges out of the quartiles
+    size_t outliers = 0;
+};
+
+// linear interpolation between the closest ranks of sorted values
+inline double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    double rank = p / 100 * (sorted.size() - 1);
+    size_t lower = static_cast<size_t>(rank);
+    size_t upper = std::min(lower + 1, sorted.size() - 1);
+    return sorted[lower] + (rank - lower) * (sorted[upper] - sorted[lower]);
+}
+
+inline Stats compute_stats(std::vector<double> timings)
+{
+    Stats stats;
+    if (timings.empty()) {
+        return stats;
+    }
+    std::sort(timings.begin(), timings.end());
+    stats.count = timings.size();
+    stats.min = timings.front();
+    stats.max = timings.back();
+    stats.mean = std::accumulate(timings.begin(), timings.end(), 0.0) /
+                 timings.size();
+    double squares = 0;
+    for (double t : timings) {
+        squares += (t - stats.mean) * (t - stats.mean);
+    }
+    if (timings.size() > 1) {
+        stats.stddev = std::sqrt(squares / (timings.size() - 1));
+    }
+    stats.cv = stats.mean > 0 ? stats.stddev / stats.mean : 0;
+    stats.median = percentile(timings, 50);
+    stats.p5 = percentile(timings, 5);
+    stats.p95 = percentile(timings, 95);
+    stats.p99 = percentile(timings, 99);
+
+    double q1 = percentile(timings, 25);
+    double q3 = percentile(timings, 75);
+    double low = q1 - 1.5 * (q3 - q1);
+    double high = q3 + 1.5 * (q3 - q1);
+    for (double t : timings) {
+        if (t < low || t > high) {
+            stats.outliers++;
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+// seeded A and B, the same on every host: mt19937_64 is fully specified,
+// unlike the std distributions
+template <class T>
+void random_matrix(std::vector<T> &matrix, size_t size, uint64_t seed)
+{
+    std::mt19937_64 generator(seed);
+    matrix.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        // uniform in [-1, 1)
+        matrix[i] = static_cast<T>((generator() >> 11) * 0x1p-52 - 1.0);
+    }
+}
+
+struct Verification {
+    size_t rows = 0; // rows of C compared with the reference
+    double max_abs_error = 0;
+    // |c - reference| / (|A| |B|), the scale of the rounding errors of any
+    // summation order
+    double max_rel_error = 0;
+    double tolerance = 0;
+    bool passed = true;
+    // threads of one trial got different results
+    bool worker_mismatch = false;
+};
+
+// rows of C = A * B in double, with |A| |B| for the relative error
+template <class T>
+void reference_row(const T *a, const T *b, size_t n, size_t k, size_t row,
+                   double *c, double *scale)
+{
+    std::fill(c, c + n, 0.0);
+    std::fill(scale, scale + n, 0.0);
+    for (size_t p = 0; p < k; p++) {
+        double value = a[row * k + p];
+        const T *b_row = b + p * n;
+        for (size_t j = 0; j < n; j++) {
+            double product = value * b_row[j];
+            c[j] += product;
+            scale[j] += std::fabs(product);
+        }
+    }
+}
+
+// compare C with the reference on every row, or on rows spread over C when
+// that costs more than max_work multiply-adds. tolerance 0 for k * epsilon,
+// which bounds the error of any order of k fused or unfused steps
+template <class T>
+Verification verify(const T *a, const T *b, const T *c, size_t m, size_t n,
+                    size_t k, double max_work, double tolerance)
+{
+    Verification result;
+    result.tolerance =
+        tolerance > 0 ? tolerance : k * std::numeric_limits<T>::epsilon();
+    size_t rows = m;
+    if (static_cast<double>(m) * n * k > max_work) {
+        rows = std::max<size_t>(2, static_cast<size_t>(max_work / n / k));
+        rows = std::min(rows, m);
+    }
+    result.rows = rows;
+
+    std::vector<double> reference(n), scale(n);
+    for (size_t r = 0; r < rows; r++) {
+        // the first and the last row, and every row of small shapes
+        size_t row = rows > 1 ? r * (m - 1) / (rows - 1) : 0;
+        reference_row(a, b, n, k, row, reference.data(), scale.data());
+        for (size_t j = 0; j < n; j++) {
+            double value = c[row * n + j];
+            double error = std::fabs(value - reference[j]);
+            double rel = scale[j] > 0 ? error / scale[j] : error;
+            if (!(error <= result.max_abs_error)) {
+                result.max_abs_error = error;
+            }
+            if (!(rel <= result.max_rel_error)) {
+                result.max_rel_error = rel;
+            }
+        }
+    }
+    result.passed = result.max_rel_error <= result.tolerance;
+    return result;
+}
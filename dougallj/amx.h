@@ -1,118 +1,193 @@
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
+
+#if defined(AMX_SIMULATOR) || defined(AMX_TRACE)
+#include <pthread.h>
+#include <stdlib.h>
+#endif
+
+// opcodes, the instruction is .word (0x201000 | (opcode << 5) | register)
+enum amx_opcode {
+  AMX_OP_LDX = 0,
+  AMX_OP_LDY = 1,
+  AMX_OP_STX = 2,
+  AMX_OP_STY = 3,
+  AMX_OP_LDZ = 4,
+  AMX_OP_STZ = 5,
+  AMX_OP_LDZI = 6,
+  AMX_OP_STZI = 7,
+  AMX_OP_EXTRX = 8,
+  AMX_OP_EXTRY = 9,
+  AMX_OP_FMA64 = 10,
+  AMX_OP_FMS64 = 11,
+  AMX_OP_FMA32 = 12,
+  AMX_OP_FMS32 = 13,
+  AMX_OP_MAC16 = 14,
+  AMX_OP_FMA16 = 15,
+  AMX_OP_FMS16 = 16,
+  AMX_OP_START_STOP = 17, // operand 0 is start, 1 is stop
+  AMX_OP_VECINT = 18,
+  AMX_OP_VECFP = 19,
+  AMX_OP_MATINT = 20,
+  AMX_OP_MATFP = 21,
+  AMX_OP_GENLUT = 22,
+  AMX_OP_COUNT = 23,
+};
+
+#ifdef AMX_SIMULATOR
+
+// every AMX_* macro runs amx_sim_execute of simulator.h, which runs the
+// simulator on a thread local state instead of the instruction, so code using
+// this header builds and runs on any host. AMX_START clears the state.
+
+void amx_sim_execute(int op, uint64_t operand);
+
+#define AMX_LDX(V) amx_sim_execute(AMX_OP_LDX, (uint64_t)(V))
+#define AMX_LDY(V) amx_sim_execute(AMX_OP_LDY, (uint64_t)(V))
+#define AMX_STX(V) amx_sim_execute(AMX_OP_STX, (uint64_t)(V))
+#define AMX_STY(V) amx_sim_execute(AMX_OP_STY, (uint64_t)(V))
+#define AMX_LDZ(V) amx_sim_execute(AMX_OP_LDZ, (uint64_t)(V))
+#define AMX_STZ(V) amx_sim_execute(AMX_OP_STZ, (uint64_t)(V))
+#define AMX_LDZI(V) amx_sim_execute(AMX_OP_LDZI, (uint64_t)(V))
+#define AMX_STZI(V) amx_sim_execute(AMX_OP_STZI, (uint64_t)(V))
+#define AMX_EXTRX(V) amx_sim_execute(AMX_OP_EXTRX, (uint64_t)(V))
+#define AMX_EXTRY(V) amx_sim_execute(AMX_OP_EXTRY, (uint64_t)(V))
+#define AMX_FMA64(V) amx_sim_execute(AMX_OP_FMA64, (uint64_t)(V))
+#define AMX_FMS64(V) amx_sim_execute(AMX_OP_FMS64, (uint64_t)(V))
+#define AMX_FMA32(V) amx_sim_execute(AMX_OP_FMA32, (uint64_t)(V))
+#define AMX_FMS32(V) amx_sim_execute(AMX_OP_FMS32, (uint64_t)(V))
+#define AMX_MAC16(V) amx_sim_execute(AMX_OP_MAC16, (uint64_t)(V))
+#define AMX_FMA16(V) amx_sim_execute(AMX_OP_FMA16, (uint64_t)(V))
+#define AMX_FMS16(V) amx_sim_execute(AMX_OP_FMS16, (uint64_t)(V))
+#define AMX_START() amx_sim_execute(AMX_OP_START_STOP, 0)
+#define AMX_STOP() amx_sim_execute(AMX_OP_START_STOP, 1)
+#define AMX_VECINT(V) amx_sim_execute(AMX_OP_VECINT, (uint64_t)(V))
+#define AMX_VECFP(V) amx_sim_execute(AMX_OP_VECFP, (uint64_t)(V))
+#define AMX_MATINT(V) amx_sim_execute(AMX_OP_MATINT, (uint64_t)(V))
+#define AMX_MATFP(V) amx_sim_execute(AMX_OP_MATFP, (uint64_t)(V))
+#define AMX_GENLUT(V) amx_sim_execute(AMX_OP_GENLUT, (uint64_t)(V))
+
+// the cpu stored to [P, P + N) before the following amx instructions, for the
+// memory model of amx_timing.h. nothing on hardware.
+void amx_sim_note_cpu_store(const void *address, uint64_t size);
+
+#define AMX_NOTE_CPU_STORE(P, N) amx_sim_note_cpu_store((P), (uint64_t)(N))
+
+#else
 
 // TODO: is it possible to not go via x0? I'm guessing not without messing with
 // the compile process, but still, kinda ugly. might at least be possible to
 // force the compiler to get the value in x0 itself
 
 // TODO: do I need memory as an input?
-#define AMX_LDX(V)                                                             \
+#define AMX_HW_LDX(V)                                                          \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (0 << 5) | 0)" ::"r"((uint64_t)V)     \
       : "x0", "memory")
-#define AMX_LDY(V)                                                             \
+#define AMX_HW_LDY(V)                                                          \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (1 << 5) | 0)" ::"r"((uint64_t)V)     \
       : "x0", "memory")
-#define AMX_STX(V)                                                             \
+#define AMX_HW_STX(V)                                                          \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (2 << 5) | 0)" ::"r"((uint64_t)V)     \
       : "x0", "memory")
-#define AMX_STY(V)                                                             \
+#define AMX_HW_STY(V)                                                          \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (3 << 5) | 0)" ::"r"((uint64_t)V)     \
       : "x0", "memory")
-#define AMX_LDZ(V)                                                             \
+#define AMX_HW_LDZ(V)                                                          \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (4 << 5) | 0)" ::"r"((uint64_t)V)     \
       : "x0", "memory")
-#define AMX_STZ(V)                                                             \
+#define AMX_HW_STZ(V)                                                          \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (5 << 5) | 0)" ::"r"((uint64_t)V)     \
       : "x0", "memory")
 
-#define AMX_LDZI(V)                                                            \
+#define AMX_HW_LDZI(V)                                                         \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (6 << 5) | 0)" ::"r"((uint64_t)V)     \
       : "x0", "memory")
-#define AMX_STZI(V)                                                            \
+#define AMX_HW_STZI(V)                                                         \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (7 << 5) | 0)" ::"r"((uint64_t)V)     \
       : "x0", "memory")
 
 // TODO: probably shouldn't say these clobber memory?
-#define AMX_EXTRX(V)                                                           \
+#define AMX_HW_EXTRX(V)                                                        \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (8 << 5) | 0)" ::"r"((uint64_t)V)     \
       : "x0", "memory")
-#define AMX_EXTRY(V)                                                           \
+#define AMX_HW_EXTRY(V)                                                        \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (9 << 5) | 0)" ::"r"((uint64_t)V)     \
       : "x0", "memory")
 
-#define AMX_FMA64(V)                                                           \
+#define AMX_HW_FMA64(V)                                                        \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (10 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
-#define AMX_FMS64(V)                                                           \
+#define AMX_HW_FMS64(V)                                                        \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (11 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
 
-#define AMX_FMA32(V)                                                           \
+#define AMX_HW_FMA32(V)                                                        \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (12 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
-#define AMX_FMS32(V)                                                           \
+#define AMX_HW_FMS32(V)                                                        \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (13 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
 
-#define AMX_MAC16(V)                                                           \
+#define AMX_HW_MAC16(V)                                                        \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (14 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
-#define AMX_FMA16(V)                                                           \
+#define AMX_HW_FMA16(V)                                                        \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (15 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
-#define AMX_FMS16(V)                                                           \
+#define AMX_HW_FMS16(V)                                                        \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (16 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
 
-#define AMX_START()                                                            \
+#define AMX_HW_START()                                                         \
   __asm__ volatile(                                                            \
       "nop \r\n nop \r\n nop \r\n .word (0x201000 | (17 << 5) | 0)" ::         \
           : "memory")
-#define AMX_STOP()                                                             \
+#define AMX_HW_STOP()                                                          \
   __asm__ volatile(                                                            \
       "nop \r\n nop \r\n nop \r\n .word (0x201000 | (17 << 5) | 1)" ::         \
           : "memory")
 
 // horizontal multiply uint16_ts? (doesn't mac16 have a flag for this?)
 // z0[i] += x0[i] + y0[i]
-#define AMX_VECINT(V)                                                          \
+#define AMX_HW_VECINT(V)                                                       \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (18 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
 
 // horizontal multiply float16_ts? (doesn't fma16 have a flag for this?)
 // z0[i] += x0[i] + y0[i]
-#define AMX_VECFP(V)                                                           \
+#define AMX_HW_VECFP(V)                                                        \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (19 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
 
 // uint16_t matrix multiply? (doesn't mac16 do this?)
-#define AMX_MATINT(V)                                                          \
+#define AMX_HW_MATINT(V)                                                       \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (20 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
 
 // float16_t matrix multiply? (doesn't fma16 do this?)
-#define AMX_MATFP(V)                                                           \
+#define AMX_HW_MATFP(V)                                                        \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (21 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
@@ -124,11 +199,83 @@
 // [0x0, 0x10000000, 0x20000000, 0x30000000, 0x40000000, 0x50000000, 0x60000000,
 // 0x70000000, 0x80000000, 0x90000000, 0xA0000000, 0xB0000000, 0xC0000000,
 // 0xD0000000, 0xE0000000, 0xF0000000] -> fffffff0f6543210
-#define AMX_GENLUT(V)                                                          \
+#define AMX_HW_GENLUT(V)                                                       \
   __asm__ volatile(                                                            \
       "mov x0, %0 \r\n .word (0x201000 | (22 << 5) | 0)" ::"r"((uint64_t)V)    \
       : "x0", "memory")
 
+#ifdef AMX_TRACE
+
+// the instruction runs, then the hooks see it (see amx_add_hook), to record
+// what a kernel issues on hardware
+
+#define AMX_HOOKED(HW, OP, V)                                                  \
+  do {                                                                         \
+    uint64_t amx_operand = (uint64_t)(V);                                      \
+    HW(amx_operand);                                                           \
+    amx_run_hooks(OP, amx_operand);                                            \
+  } while (0)
+
+#define AMX_LDX(V) AMX_HOOKED(AMX_HW_LDX, AMX_OP_LDX, V)
+#define AMX_LDY(V) AMX_HOOKED(AMX_HW_LDY, AMX_OP_LDY, V)
+#define AMX_STX(V) AMX_HOOKED(AMX_HW_STX, AMX_OP_STX, V)
+#define AMX_STY(V) AMX_HOOKED(AMX_HW_STY, AMX_OP_STY, V)
+#define AMX_LDZ(V) AMX_HOOKED(AMX_HW_LDZ, AMX_OP_LDZ, V)
+#define AMX_STZ(V) AMX_HOOKED(AMX_HW_STZ, AMX_OP_STZ, V)
+#define AMX_LDZI(V) AMX_HOOKED(AMX_HW_LDZI, AMX_OP_LDZI, V)
+#define AMX_STZI(V) AMX_HOOKED(AMX_HW_STZI, AMX_OP_STZI, V)
+#define AMX_EXTRX(V) AMX_HOOKED(AMX_HW_EXTRX, AMX_OP_EXTRX, V)
+#define AMX_EXTRY(V) AMX_HOOKED(AMX_HW_EXTRY, AMX_OP_EXTRY, V)
+#define AMX_FMA64(V) AMX_HOOKED(AMX_HW_FMA64, AMX_OP_FMA64, V)
+#define AMX_FMS64(V) AMX_HOOKED(AMX_HW_FMS64, AMX_OP_FMS64, V)
+#define AMX_FMA32(V) AMX_HOOKED(AMX_HW_FMA32, AMX_OP_FMA32, V)
+#define AMX_FMS32(V) AMX_HOOKED(AMX_HW_FMS32, AMX_OP_FMS32, V)
+#define AMX_MAC16(V) AMX_HOOKED(AMX_HW_MAC16, AMX_OP_MAC16, V)
+#define AMX_FMA16(V) AMX_HOOKED(AMX_HW_FMA16, AMX_OP_FMA16, V)
+#define AMX_FMS16(V) AMX_HOOKED(AMX_HW_FMS16, AMX_OP_FMS16, V)
+#define AMX_HW_START_V(V) AMX_HW_START()
+#define AMX_START() AMX_HOOKED(AMX_HW_START_V, AMX_OP_START_STOP, 0)
+#define AMX_HW_STOP_V(V) AMX_HW_STOP()
+#define AMX_STOP() AMX_HOOKED(AMX_HW_STOP_V, AMX_OP_START_STOP, 1)
+#define AMX_VECINT(V) AMX_HOOKED(AMX_HW_VECINT, AMX_OP_VECINT, V)
+#define AMX_VECFP(V) AMX_HOOKED(AMX_HW_VECFP, AMX_OP_VECFP, V)
+#define AMX_MATINT(V) AMX_HOOKED(AMX_HW_MATINT, AMX_OP_MATINT, V)
+#define AMX_MATFP(V) AMX_HOOKED(AMX_HW_MATFP, AMX_OP_MATFP, V)
+#define AMX_GENLUT(V) AMX_HOOKED(AMX_HW_GENLUT, AMX_OP_GENLUT, V)
+
+#else
+
+#define AMX_LDX(V) AMX_HW_LDX(V)
+#define AMX_LDY(V) AMX_HW_LDY(V)
+#define AMX_STX(V) AMX_HW_STX(V)
+#define AMX_STY(V) AMX_HW_STY(V)
+#define AMX_LDZ(V) AMX_HW_LDZ(V)
+#define AMX_STZ(V) AMX_HW_STZ(V)
+#define AMX_LDZI(V) AMX_HW_LDZI(V)
+#define AMX_STZI(V) AMX_HW_STZI(V)
+#define AMX_EXTRX(V) AMX_HW_EXTRX(V)
+#define AMX_EXTRY(V) AMX_HW_EXTRY(V)
+#define AMX_FMA64(V) AMX_HW_FMA64(V)
+#define AMX_FMS64(V) AMX_HW_FMS64(V)
+#define AMX_FMA32(V) AMX_HW_FMA32(V)
+#define AMX_FMS32(V) AMX_HW_FMS32(V)
+#define AMX_MAC16(V) AMX_HW_MAC16(V)
+#define AMX_FMA16(V) AMX_HW_FMA16(V)
+#define AMX_FMS16(V) AMX_HW_FMS16(V)
+#define AMX_START() AMX_HW_START()
+#define AMX_STOP() AMX_HW_STOP()
+#define AMX_VECINT(V) AMX_HW_VECINT(V)
+#define AMX_VECFP(V) AMX_HW_VECFP(V)
+#define AMX_MATINT(V) AMX_HW_MATINT(V)
+#define AMX_MATFP(V) AMX_HW_MATFP(V)
+#define AMX_GENLUT(V) AMX_HW_GENLUT(V)
+
+#endif
+
+#define AMX_NOTE_CPU_STORE(P, N) ((void)(P), (void)(N))
+
+#endif
+
 typedef _Float16 float16;
 
 union amx_row {
@@ -148,6 +295,94 @@ struct amx_state {
   union amx_row z[64];
 };
 
+#if defined(AMX_SIMULATOR) || defined(AMX_TRACE)
+
+// hooks see every instruction of every thread after it runs (timing models,
+// tracing). they can be added and removed while other threads run amx code:
+// the list is a table that is replaced, never changed, so a thread running
+// the hooks always sees a whole list. replaced tables are not freed, a thread
+// may still be running one, and hooks change rarely.
+
+#define AMX_MAX_HOOKS 8
+
+typedef void (*amx_hook_fn)(void *context, int op, uint64_t operand);
+
+struct amx_hook {
+  amx_hook_fn fn;
+  void *context;
+};
+
+struct amx_hook_table {
+  int count;
+  struct amx_hook hooks[AMX_MAX_HOOKS];
+};
+
+static struct amx_hook_table *amx_hook_table = NULL;
+static pthread_mutex_t amx_hook_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// a copy of the current table, to change and publish
+static struct amx_hook_table *amx_hook_copy(void) {
+  struct amx_hook_table *table =
+      (struct amx_hook_table *)malloc(sizeof *table);
+  if (table == NULL) {
+    return NULL;
+  }
+  if (amx_hook_table) {
+    *table = *amx_hook_table;
+  } else {
+    memset(table, 0, sizeof *table);
+  }
+  return table;
+}
+
+int amx_add_hook(amx_hook_fn fn, void *context) {
+  pthread_mutex_lock(&amx_hook_lock);
+  struct amx_hook_table *table = amx_hook_copy();
+  if (table == NULL || table->count == AMX_MAX_HOOKS) {
+    pthread_mutex_unlock(&amx_hook_lock);
+    free(table);
+    return -1;
+  }
+  table->hooks[table->count].fn = fn;
+  table->hooks[table->count].context = context;
+  table->count++;
+  __atomic_store_n(&amx_hook_table, table, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&amx_hook_lock);
+  return 0;
+}
+
+void amx_remove_hook(amx_hook_fn fn, void *context) {
+  pthread_mutex_lock(&amx_hook_lock);
+  for (int i = 0; amx_hook_table && i < amx_hook_table->count; i++) {
+    struct amx_hook *hook = &amx_hook_table->hooks[i];
+    if (hook->fn != fn || hook->context != context) {
+      continue;
+    }
+    struct amx_hook_table *table = amx_hook_copy();
+    if (table) {
+      memmove(&table->hooks[i], &table->hooks[i + 1],
+              (table->count - i - 1) * sizeof(struct amx_hook));
+      table->count--;
+      __atomic_store_n(&amx_hook_table, table, __ATOMIC_RELEASE);
+    }
+    break;
+  }
+  pthread_mutex_unlock(&amx_hook_lock);
+}
+
+static inline void amx_run_hooks(int op, uint64_t operand) {
+  const struct amx_hook_table *table =
+      __atomic_load_n(&amx_hook_table, __ATOMIC_ACQUIRE);
+  if (table == NULL) {
+    return;
+  }
+  for (int i = 0; i < table->count; i++) {
+    table->hooks[i].fn(table->hooks[i].context, op, operand);
+  }
+}
+
+#endif
+
 void store_amx_state(struct amx_state *state) {
   memset(state, 0xAA, sizeof *state);
   for (uint64_t i = 0; i < 8; i++) {
@@ -172,3 +407,11 @@ void load_amx_state(struct amx_state *state) {
     AMX_LDZ((i << 56) | (uint64_t)&state->z[i]);
   }
 }
+
+#ifdef AMX_SIMULATOR
+#include "simulator.h"
+#endif
+
+#if defined(AMX_TRACE) && !defined(AMX_SIMULATOR)
+#include "amx_trace.h"
+#endif
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "amx.h"
+#include "amx_timing.h"
+
+// static analysis of an amx instruction stream, fed one instruction at a time
+// (amx_analysis_issue), from a simulator hook or from a trace.
+//
+// the dependency graph has an edge from the last writer of every x, y or z row
+// an instruction reads, and from the last writer of the z rows it writes (x and
+// y are renamed, see amx_timing.h). an fma32 in matrix mode reads and writes
+// the z group z_offset & 3, the 16 rows 4 apart, so two fma32 into the same
+// group are dependent and fma32 into different groups are not.
+//
+// with the latencies of amx_timing_params and unlimited units this gives:
+//   critical path: the longest chain of dependent instructions, in cycles
+//   bound: the largest of the critical path, the busy time of every unit and
+//     the issue time, i.e. what limits the stream
+//   z reuse distance: fmas issued between two fmas accumulating into the same
+//     z rows (1 is back to back)
+//   accumulator stalls: cycles an fma waits for the previous fma into its z
+//     rows when fewer than fma_latency / fma_cycles accumulators are in use
+
+#define AMX_ANALYSIS_MAX_ACCUMULATORS 64
+#define AMX_ANALYSIS_DISTANCES 7
+
+static const char *amx_opcode_names[AMX_OP_COUNT] = {
+    "ldx",   "ldy",   "stx",   "sty",    "ldz",    "stz",   "ldzi",   "stzi",
+    "extrx", "extry", "fma64", "fms64",  "fma32",  "fms32", "mac16",  "fma16",
+    "fms16", "start", "vecint", "vecfp", "matint", "matfp", "genlut",
+};
+
+// longest chain ending at the last write of a row
+struct amx_analysis_path {
+  double done;
+  uint64_t depth;
+  uint64_t loads;
+  uint64_t fmas;
+};
+
+struct amx_analysis {
+  struct amx_timing_params params;
+
+  struct amx_analysis_path x[8], y[8], z[64];
+  struct amx_analysis_path critical;
+
+  // index in the fma stream of the last fma writing each z row, +1
+  uint64_t z_last_fma[64];
+  uint64_t accumulators[AMX_ANALYSIS_MAX_ACCUMULATORS];
+  int accumulator_count;
+
+  uint64_t instructions;
+  uint64_t ops[AMX_OP_COUNT];
+  double op_busy[AMX_OP_COUNT];
+  double unit_busy[AMX_UNIT_COUNT];
+  uint64_t loads;
+  uint64_t stores;
+  uint64_t fmas;
+  uint64_t flops;
+  uint64_t bytes_loaded;
+  uint64_t bytes_stored;
+  uint64_t distances[AMX_ANALYSIS_DISTANCES];
+  uint64_t accumulator_stalled; // fmas that waited
+  double accumulator_stall;     // cycles
+};
+
+static const char *amx_analysis_distance_names[AMX_ANALYSIS_DISTANCES] = {
+    "1", "2", "3", "4-7", "8-15", "16-63", "64+",
+};
+
+// params NULL for the defaults of amx_timing.h
+void amx_analysis_init(struct amx_analysis *analysis,
+                       const struct amx_timing_params *params) {
+  memset(analysis, 0, sizeof *analysis);
+  analysis->params = params ? *params : amx_timing_default_params();
+}
+
+static int amx_analysis_distance_bucket(uint64_t distance) {
+  if (distance <= 3) {
+    return (int)distance - 1;
+  }
+  if (distance < 8) {
+    return 3;
+  }
+  if (distance < 16) {
+    return 4;
+  }
+  return distance < 64 ? 5 : 6;
+}
+
+static void amx_analysis_longest(struct amx_analysis_path *path, uint64_t mask,
+                                 int count,
+                                 const struct amx_analysis_path *rows) {
+  for (int r = 0; r < count; r++) {
+    if (((mask >> r) & 1) && rows[r].done > path->done) {
+      *path = rows[r];
+    }
+  }
+}
+
+static void amx_analysis_set(struct amx_analysis_path *rows, uint64_t mask,
+                             int count, const struct amx_analysis_path *path) {
+  for (int r = 0; r < count; r++) {
+    if ((mask >> r) & 1) {
+      rows[r] = *path;
+    }
+  }
+}
+
+static bool amx_analysis_is_fma(int op) {
+  return op >= AMX_OP_FMA64 && op <= AMX_OP_FMS16;
+}
+
+void amx_analysis_issue(struct amx_analysis *analysis, int op,
+                        uint64_t operand) {
+  const struct amx_timing_params *p = &analysis->params;
+  if (op == AMX_OP_START_STOP || op < 0 || op >= AMX_OP_COUNT) {
+    return;
+  }
+
+  struct amx_timing_rows read, write;
+  uint64_t flops;
+  amx_timing_decode(op, operand, &read, &write, &flops);
+  int unit = amx_timing_unit_of(op);
+  bool load = amx_timing_is_load(op);
+
+  double busy, latency;
+  if (unit == AMX_UNIT_MEMORY) {
+    uint64_t bytes = amx_timing_bytes(op, operand);
+    busy = (load ? p->load_row_cycles : p->store_row_cycles) * (bytes / 0x40);
+    latency = load ? p->load_latency : p->store_latency;
+    if (load) {
+      analysis->loads++;
+      analysis->bytes_loaded += bytes;
+    } else {
+      analysis->stores++;
+      analysis->bytes_stored += bytes;
+    }
+  } else if (unit == AMX_UNIT_FMA) {
+    busy = p->fma_cycles;
+    latency = p->fma_latency;
+  } else {
+    busy = p->extr_cycles;
+    latency = p->extr_latency;
+  }
+  latency = amx_timing_max(latency, busy);
+
+  // raw on x, y and z, waw on z
+  struct amx_analysis_path path;
+  memset(&path, 0, sizeof path);
+  amx_analysis_longest(&path, read.x, 8, analysis->x);
+  amx_analysis_longest(&path, read.y, 8, analysis->y);
+  amx_analysis_longest(&path, read.z | write.z, 64, analysis->z);
+  path.done += latency;
+  path.depth++;
+  path.loads += load;
+  path.fmas += amx_analysis_is_fma(op);
+  amx_analysis_set(analysis->x, write.x, 8, &path);
+  amx_analysis_set(analysis->y, write.y, 8, &path);
+  amx_analysis_set(analysis->z, write.z, 64, &path);
+  if (path.done > analysis->critical.done) {
+    analysis->critical = path;
+  }
+
+  if (amx_analysis_is_fma(op) && write.z) {
+    analysis->fmas++;
+    uint64_t last = 0;
+    for (int r = 0; r < 64; r++) {
+      if (((write.z & read.z) >> r) & 1 && analysis->z_last_fma[r] > last) {
+        last = analysis->z_last_fma[r];
+      }
+      if ((write.z >> r) & 1) {
+        analysis->z_last_fma[r] = analysis->fmas;
+      }
+    }
+    if (last) {
+      uint64_t distance = analysis->fmas - last;
+      analysis->distances[amx_analysis_distance_bucket(distance)]++;
+      double stall = p->fma_latency - distance * p->fma_cycles;
+      if (stall > 0) {
+        analysis->accumulator_stalled++;
+        analysis->accumulator_stall += stall;
+      }
+    }
+    bool known = false;
+    for (int a = 0; a < analysis->accumulator_count; a++) {
+      known |= analysis->accumulators[a] == write.z;
+    }
+    if (!known && analysis->accumulator_count < AMX_ANALYSIS_MAX_ACCUMULATORS) {
+      analysis->accumulators[analysis->accumulator_count++] = write.z;
+    }
+  }
+
+  analysis->instructions++;
+  analysis->ops[op]++;
+  analysis->op_busy[op] += busy;
+  analysis->unit_busy[unit] += busy;
+  analysis->flops += flops;
+}
+
+void amx_analysis_print(const struct amx_analysis *analysis, FILE *file) {
+  static const char *unit_names[AMX_UNIT_COUNT] = {"memory", "fma", "extr"};
+  const struct amx_timing_params *p = &analysis->params;
+  const struct amx_analysis_path *critical = &analysis->critical;
+
+  double issue = analysis->instructions * p->issue_cycles;
+  double bound = critical->done;
+  const char *bound_name = "dependencies";
+  for (int u = 0; u < AMX_UNIT_COUNT; u++) {
+    if (analysis->unit_busy[u] > bound) {
+      bound = analysis->unit_busy[u];
+      bound_name = unit_names[u];
+    }
+  }
+  if (issue > bound) {
+    bound = issue;
+    bound_name = "issue";
+  }
+  double cycles = bound > 0 ? bound : 1;
+
+  fprintf(file, "instructions %llu, flops %llu, loaded %llu B, stored %llu B\n",
+          (unsigned long long)analysis->instructions,
+          (unsigned long long)analysis->flops,
+          (unsigned long long)analysis->bytes_loaded,
+          (unsigned long long)analysis->bytes_stored);
+  fprintf(file,
+          "critical path %.0f cycles, %llu instructions (%llu loads, %llu "
+          "fmas)\n",
+          critical->done, (unsigned long long)critical->depth,
+          (unsigned long long)critical->loads,
+          (unsigned long long)critical->fmas);
+  fprintf(file, "bound %.0f cycles by %s, %.3f GFLOP/s at %.2f GHz\n", bound,
+          bound_name, analysis->flops * p->frequency_ghz / cycles,
+          p->frequency_ghz);
+  fprintf(file, "fma/load %.2f, flops/byte loaded %.2f\n",
+          analysis->loads ? (double)analysis->fmas / analysis->loads : 0.0,
+          analysis->bytes_loaded
+              ? (double)analysis->flops / analysis->bytes_loaded
+              : 0.0);
+
+  fprintf(file, "%-7s %10s %7s %7s\n", "op", "count", "share", "busy");
+  for (int op = 0; op < AMX_OP_COUNT; op++) {
+    if (analysis->ops[op] == 0) {
+      continue;
+    }
+    fprintf(file, "%-7s %10llu %6.1f%% %6.1f%%\n", amx_opcode_names[op],
+            (unsigned long long)analysis->ops[op],
+            100.0 * analysis->ops[op] / analysis->instructions,
+            100.0 * analysis->op_busy[op] / cycles);
+  }
+
+  uint64_t reused = 0;
+  for (int d = 0; d < AMX_ANALYSIS_DISTANCES; d++) {
+    reused += analysis->distances[d];
+  }
+  fprintf(file, "accumulators %d (%.0f needed to hide the fma latency)\n",
+          analysis->accumulator_count, p->fma_latency / p->fma_cycles);
+  fprintf(file, "z reuse distance:");
+  for (int d = 0; d < AMX_ANALYSIS_DISTANCES; d++) {
+    fprintf(file, " %s: %.1f%%", amx_analysis_distance_names[d],
+            reused ? 100.0 * analysis->distances[d] / reused : 0.0);
+  }
+  fprintf(file, "\n");
+  fprintf(file, "accumulator stalls: %llu fmas, %.0f cycles\n",
+          (unsigned long long)analysis->accumulator_stalled,
+          analysis->accumulator_stall);
+}
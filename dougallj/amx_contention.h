@@ -0,0 +1,300 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "amx.h"
+#include "amx_timing.h"
+
+// model of threads sharing amx units, to predict how a multithreaded driver
+// scales from one recorded run.
+//
+// every thread runs a list of segments: cpu work (packing, the driver) then
+// one AMX_START/AMX_STOP region of amx_cycles from the timing model. thread t
+// runs on its own core and uses unit t % units (aarch64_amx.py: "there is
+// probably only one AMX coprocessor on the M1, as multiple threads trying to
+// use AMX at the same time cause a slow-down").
+//
+// a unit runs one context at a time, round robin between the threads waiting
+// for it, for at most quantum_cycles. taking the unit from a thread in the
+// middle of its region saves its registers (0x1400 bytes: x, y and z) and
+// giving it back restores them; a region that starts with AMX_START has no
+// state to restore. the defaults of the save and restore are 80 rows at the
+// store and load costs of amx_timing.h. the quantum is a guess.
+
+struct amx_contention_params {
+  int units;
+  double quantum_cycles;
+  double save_cycles;
+  double restore_cycles;
+  double frequency_ghz;
+  double cpu_scale; // target cycles per host cycle of recorded cpu work
+};
+
+struct amx_contention_segment {
+  int job; // set by amx_contention_begin_job, -1 before
+  double cpu_cycles;
+  double amx_cycles;
+  // from amx_contention_predict
+  double begin; // cpu work starts
+  double end;   // the region is done
+  double waited;
+};
+
+struct amx_contention_thread {
+  struct amx_contention_segment *segments;
+  int count;
+  int capacity;
+  double end;
+  double waited;   // for a busy unit
+  double switches; // cycles saving and restoring
+};
+
+struct amx_contention_params amx_contention_default_params(void) {
+  struct amx_timing_params timing = amx_timing_default_params();
+  struct amx_contention_params params;
+  params.units = 1;
+  params.quantum_cycles = 32000.0;
+  params.save_cycles = 80 * timing.store_row_cycles;
+  params.restore_cycles = 80 * timing.load_row_cycles;
+  params.frequency_ghz = timing.frequency_ghz;
+  params.cpu_scale = 1.0;
+  return params;
+}
+
+void amx_contention_add(struct amx_contention_thread *thread, int job,
+                        double cpu_cycles, double amx_cycles) {
+  if (thread->count == thread->capacity) {
+    int capacity = thread->capacity ? thread->capacity * 2 : 16;
+    struct amx_contention_segment *segments =
+        (struct amx_contention_segment *)realloc(
+            thread->segments, capacity * sizeof *segments);
+    if (segments == NULL) {
+      return;
+    }
+    thread->segments = segments;
+    thread->capacity = capacity;
+  }
+  struct amx_contention_segment *segment = &thread->segments[thread->count++];
+  memset(segment, 0, sizeof *segment);
+  segment->job = job;
+  segment->cpu_cycles = cpu_cycles;
+  segment->amx_cycles = amx_cycles;
+}
+
+void amx_contention_clear(struct amx_contention_thread *thread) {
+  free(thread->segments);
+  memset(thread, 0, sizeof *thread);
+}
+
+// schedule the segments of threads[0..count) and return the wall cycles.
+// params NULL for the defaults.
+double amx_contention_predict(const struct amx_contention_params *params,
+                              struct amx_contention_thread *threads,
+                              int count) {
+  struct amx_contention_params p =
+      params ? *params : amx_contention_default_params();
+  if (p.units < 1) {
+    p.units = 1;
+  }
+  double wall = 0;
+  // threads of different units never wait for each other
+  for (int unit = 0; unit < p.units; unit++) {
+    // per thread: next segment, when it wants the unit, amx cycles left
+    int *next = (int *)calloc(count, sizeof(int));
+    double *ready = (double *)calloc(count, sizeof(double));
+    double *left = (double *)calloc(count, sizeof(double));
+    bool *live = (bool *)calloc(count, sizeof(bool));
+    int pending = 0;
+    for (int t = unit; t < count; t += p.units) {
+      struct amx_contention_thread *thread = &threads[t];
+      thread->end = 0;
+      thread->waited = 0;
+      thread->switches = 0;
+      if (thread->count) {
+        thread->segments[0].begin = 0;
+        ready[t] = thread->segments[0].cpu_cycles * p.cpu_scale;
+        left[t] = thread->segments[0].amx_cycles;
+        pending++;
+      }
+    }
+
+    double now = 0;
+    int owner = -1; // context in the unit, -1 if none or stopped
+    int last = -1;  // round robin
+    while (pending) {
+      int pick = -1;
+      double first = -1;
+      for (int step = 1; step <= count; step++) {
+        int t = (last + step + count) % count;
+        if (t % p.units != unit || next[t] == threads[t].count) {
+          continue;
+        }
+        if (ready[t] <= now) {
+          pick = t;
+          break;
+        }
+        if (first < 0 || ready[t] < first) {
+          first = ready[t];
+        }
+      }
+      if (pick < 0) {
+        now = first;
+        continue;
+      }
+
+      struct amx_contention_thread *thread = &threads[pick];
+      struct amx_contention_segment *segment = &thread->segments[next[pick]];
+      if (owner != pick) {
+        double cost = 0;
+        if (owner >= 0) {
+          cost += p.save_cycles;
+        }
+        if (live[pick]) {
+          cost += p.restore_cycles;
+        }
+        now += cost;
+        thread->switches += cost;
+      }
+      segment->waited += now - ready[pick];
+      thread->waited += now - ready[pick];
+
+      double slice = left[pick] < p.quantum_cycles ? left[pick] : p.quantum_cycles;
+      now += slice;
+      left[pick] -= slice;
+      owner = pick;
+      last = pick;
+      ready[pick] = now;
+      live[pick] = left[pick] > 0;
+      if (left[pick] > 0) {
+        continue;
+      }
+
+      // AMX_STOP: the context is gone
+      owner = -1;
+      segment->end = now;
+      thread->end = now;
+      if (now > wall) {
+        wall = now;
+      }
+      if (++next[pick] == thread->count) {
+        pending--;
+      } else {
+        struct amx_contention_segment *following = &thread->segments[next[pick]];
+        following->begin = now;
+        ready[pick] = now + following->cpu_cycles * p.cpu_scale;
+        left[pick] = following->amx_cycles;
+      }
+    }
+    free(next);
+    free(ready);
+    free(left);
+    free(live);
+  }
+  return wall;
+}
+
+#ifdef AMX_SIMULATOR
+
+// recording: every thread gets a list of segments. AMX_START closes the cpu
+// work of the thread since the last AMX_STOP or amx_contention_begin_job (its
+// thread cpu time), and AMX_STOP adds the cycles of the timing model.
+
+#define AMX_CONTENTION_MAX_THREADS 64
+
+static struct amx_contention_thread
+    amx_contention_threads[AMX_CONTENTION_MAX_THREADS];
+static int amx_contention_thread_count = 0;
+static pthread_mutex_t amx_contention_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct amx_timing_params amx_contention_timing_params;
+static int amx_contention_generation = 0;
+
+static __thread int amx_contention_index = -1;
+static __thread int amx_contention_thread_generation = -1;
+static __thread int amx_contention_job = -1;
+static __thread double amx_contention_cpu_mark;
+static __thread double amx_contention_cpu; // seconds before AMX_START
+static __thread struct amx_timing amx_contention_timing;
+
+static double amx_contention_cpu_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the thread of the caller, registered on first use
+static struct amx_contention_thread *amx_contention_self(void) {
+  if (amx_contention_thread_generation != amx_contention_generation) {
+    pthread_mutex_lock(&amx_contention_lock);
+    amx_contention_index = -1;
+    if (amx_contention_thread_count < AMX_CONTENTION_MAX_THREADS) {
+      amx_contention_index = amx_contention_thread_count++;
+    }
+    amx_contention_thread_generation = amx_contention_generation;
+    pthread_mutex_unlock(&amx_contention_lock);
+    amx_contention_job = -1;
+    amx_contention_cpu_mark = amx_contention_cpu_seconds();
+  }
+  if (amx_contention_index < 0) {
+    return NULL;
+  }
+  return &amx_contention_threads[amx_contention_index];
+}
+
+// the cpu work of the calling thread starts now, its segments are job
+void amx_contention_begin_job(int job) {
+  amx_contention_self();
+  amx_contention_job = job;
+  amx_contention_cpu_mark = amx_contention_cpu_seconds();
+}
+
+static void amx_contention_hook(void *context, int op, uint64_t operand) {
+  (void)context;
+  if (op != AMX_OP_START_STOP) {
+    amx_timing_issue(&amx_contention_timing, op, operand);
+    return;
+  }
+  struct amx_contention_thread *thread = amx_contention_self();
+  double now = amx_contention_cpu_seconds();
+  if (operand == 0) {
+    amx_contention_cpu = now - amx_contention_cpu_mark;
+    amx_timing_init(&amx_contention_timing, &amx_contention_timing_params);
+  } else {
+    if (thread) {
+      amx_contention_add(thread, amx_contention_job,
+                         amx_contention_cpu *
+                             amx_contention_timing_params.frequency_ghz * 1e9,
+                         amx_contention_timing.cycles);
+    }
+    amx_contention_cpu_mark = now;
+  }
+}
+
+// forget the threads and record from now, timing params NULL for the defaults.
+// no thread may use amx while this runs.
+void amx_contention_record(const struct amx_timing_params *params) {
+  amx_remove_hook(amx_contention_hook, NULL);
+  pthread_mutex_lock(&amx_contention_lock);
+  for (int t = 0; t < amx_contention_thread_count; t++) {
+    amx_contention_clear(&amx_contention_threads[t]);
+  }
+  amx_contention_thread_count = 0;
+  amx_contention_generation++;
+  pthread_mutex_unlock(&amx_contention_lock);
+  amx_contention_timing_params = params ? *params : amx_timing_default_params();
+  amx_add_hook(amx_contention_hook, NULL);
+}
+
+// stop recording, the threads stay until the next amx_contention_record
+struct amx_contention_thread *amx_contention_stop(int *count) {
+  amx_remove_hook(amx_contention_hook, NULL);
+  *count = amx_contention_thread_count;
+  return amx_contention_threads;
+}
+
+#endif
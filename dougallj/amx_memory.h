@@ -0,0 +1,256 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amx.h"
+
+// model of the caches seen by amx loads and stores, for amx_timing.h.
+//
+// aarch64_amx.py: amx loads and stores "appear to go via L2, with slight
+// penalties for data in L1", and mixing cpu stores with amx loads and stores
+// is slow, much slower when they alias:
+//   str before AMXLDX: 47 cycles/iter, 93 if aliasing (9 without the str)
+//   str before AMXSTX: 48 cycles/iter, 115 if aliasing (28 without the str)
+//
+// so: the cpu stores (AMX_NOTE_CPU_STORE) allocate dirty lines in L1, L2
+// holds every line of L1. an amx load or store of a line dirty in L1 pays the
+// aliasing part of those costs (the non aliasing part is the cpu store penalty
+// of amx_timing.h), a line clean in L1 pays l1_penalty, and a line missing
+// from L2 pays memory_line_cycles (streaming, the latency is hidden). amx
+// stores write L2 and drop the line from L1.
+//
+// sizes are the ones of a performance core of the M1, the penalties of clean
+// L1 lines and memory are guesses.
+
+struct amx_cache_params {
+  uint64_t size;
+  uint64_t line;
+  uint64_t ways;
+};
+
+struct amx_memory_params {
+  struct amx_cache_params l1;
+  struct amx_cache_params l2;
+  double l1_penalty;
+  double l1_dirty_load_penalty;
+  double l1_dirty_store_penalty;
+  double memory_line_cycles;
+};
+
+struct amx_cache {
+  struct amx_cache_params params;
+  uint64_t sets;
+  uint64_t *tags; // line address + 1, 0 if empty
+  uint64_t *used; // lru stamp
+  bool *dirty;
+  uint64_t clock;
+};
+
+struct amx_memory {
+  struct amx_memory_params params;
+  struct amx_cache l1;
+  struct amx_cache l2;
+
+  // statistics
+  uint64_t cpu_bytes_stored;
+  uint64_t bytes_l1;       // amx bytes of lines clean in L1
+  uint64_t bytes_l1_dirty; // amx bytes of lines stored by the cpu
+  uint64_t bytes_l2;
+  uint64_t bytes_memory;
+  uint64_t interference;      // amx instructions that hit a dirty L1 line
+  double interference_cycles; // their penalties
+  double penalty_cycles;      // all penalties
+};
+
+struct amx_memory_params amx_memory_default_params(void) {
+  struct amx_memory_params params;
+  params.l1.size = 128 << 10;
+  params.l1.line = 128;
+  params.l1.ways = 8;
+  params.l2.size = 12 << 20;
+  params.l2.line = 128;
+  params.l2.ways = 12;
+  params.l1_penalty = 2.0;
+  params.l1_dirty_load_penalty = 93.0 - 47.0;
+  params.l1_dirty_store_penalty = 115.0 - 48.0;
+  // 60 GB/s at 3.2 GHz
+  params.memory_line_cycles = 128.0 / (60.0 / 3.2);
+  return params;
+}
+
+// return 0 on success
+static int amx_cache_init(struct amx_cache *cache,
+                          const struct amx_cache_params *params) {
+  memset(cache, 0, sizeof *cache);
+  cache->params = *params;
+  if (params->line == 0 || params->ways == 0 ||
+      params->size < params->line * params->ways) {
+    return -1;
+  }
+  cache->sets = params->size / (params->line * params->ways);
+  uint64_t lines = cache->sets * params->ways;
+  cache->tags = (uint64_t *)calloc(lines, sizeof(uint64_t));
+  cache->used = (uint64_t *)calloc(lines, sizeof(uint64_t));
+  cache->dirty = (bool *)calloc(lines, sizeof(bool));
+  if (!cache->tags || !cache->used || !cache->dirty) {
+    return -1;
+  }
+  return 0;
+}
+
+static void amx_cache_free(struct amx_cache *cache) {
+  free(cache->tags);
+  free(cache->used);
+  free(cache->dirty);
+  memset(cache, 0, sizeof *cache);
+}
+
+// index of the line of address, -1 if missing
+static int64_t amx_cache_find(struct amx_cache *cache, uint64_t address) {
+  uint64_t line = address / cache->params.line;
+  uint64_t set = line % cache->sets;
+  for (uint64_t w = 0; w < cache->params.ways; w++) {
+    uint64_t i = set * cache->params.ways + w;
+    if (cache->tags[i] == line + 1) {
+      cache->used[i] = ++cache->clock;
+      return (int64_t)i;
+    }
+  }
+  return -1;
+}
+
+// the line of address, replacing the least recently used line of its set
+static int64_t amx_cache_insert(struct amx_cache *cache, uint64_t address) {
+  int64_t i = amx_cache_find(cache, address);
+  if (i >= 0) {
+    return i;
+  }
+  uint64_t line = address / cache->params.line;
+  uint64_t set = line % cache->sets;
+  uint64_t victim = set * cache->params.ways;
+  for (uint64_t w = 1; w < cache->params.ways; w++) {
+    uint64_t j = set * cache->params.ways + w;
+    if (cache->used[j] < cache->used[victim]) {
+      victim = j;
+    }
+  }
+  cache->tags[victim] = line + 1;
+  cache->used[victim] = ++cache->clock;
+  cache->dirty[victim] = false;
+  return (int64_t)victim;
+}
+
+// params NULL for the defaults, return 0 on success
+int amx_memory_init(struct amx_memory *memory,
+                    const struct amx_memory_params *params) {
+  memset(memory, 0, sizeof *memory);
+  memory->params = params ? *params : amx_memory_default_params();
+  // one line size for both
+  memory->params.l1.line = memory->params.l2.line;
+  if (amx_cache_init(&memory->l1, &memory->params.l1) ||
+      amx_cache_init(&memory->l2, &memory->params.l2)) {
+    amx_cache_free(&memory->l1);
+    amx_cache_free(&memory->l2);
+    return -1;
+  }
+  return 0;
+}
+
+void amx_memory_free(struct amx_memory *memory) {
+  amx_cache_free(&memory->l1);
+  amx_cache_free(&memory->l2);
+}
+
+// empty caches, e.g. between kernels
+void amx_memory_flush(struct amx_memory *memory) {
+  struct amx_cache *caches[2] = {&memory->l1, &memory->l2};
+  for (int c = 0; c < 2; c++) {
+    uint64_t lines = caches[c]->sets * caches[c]->params.ways;
+    memset(caches[c]->tags, 0, lines * sizeof(uint64_t));
+    memset(caches[c]->dirty, 0, lines * sizeof(bool));
+  }
+}
+
+void amx_memory_reset_stats(struct amx_memory *memory) {
+  memory->cpu_bytes_stored = 0;
+  memory->bytes_l1 = 0;
+  memory->bytes_l1_dirty = 0;
+  memory->bytes_l2 = 0;
+  memory->bytes_memory = 0;
+  memory->interference = 0;
+  memory->interference_cycles = 0;
+  memory->penalty_cycles = 0;
+}
+
+void amx_memory_cpu_store(struct amx_memory *memory, const void *address,
+                          uint64_t size) {
+  uint64_t line = memory->params.l2.line;
+  uint64_t begin = (uint64_t)address;
+  for (uint64_t a = begin - begin % line; a < begin + size; a += line) {
+    amx_cache_insert(&memory->l2, a);
+    memory->l1.dirty[amx_cache_insert(&memory->l1, a)] = true;
+  }
+  memory->cpu_bytes_stored += size;
+}
+
+// cycles of penalty of an amx load or store of [address, address + bytes)
+double amx_memory_access(struct amx_memory *memory, bool load,
+                         uint64_t address, uint64_t bytes) {
+  const struct amx_memory_params *p = &memory->params;
+  uint64_t line = p->l2.line;
+  double penalty = 0;
+  bool dirty = false;
+  for (uint64_t a = address - address % line; a < address + bytes;
+       a += line) {
+    uint64_t first = a > address ? a : address;
+    uint64_t last = a + line < address + bytes ? a + line : address + bytes;
+    uint64_t part = last - first;
+    int64_t l1 = amx_cache_find(&memory->l1, a);
+    if (l1 >= 0 && memory->l1.dirty[l1]) {
+      // written back to L2 first
+      dirty = true;
+      memory->l1.dirty[l1] = false;
+      memory->bytes_l1_dirty += part;
+    } else if (l1 >= 0) {
+      penalty += p->l1_penalty;
+      memory->bytes_l1 += part;
+    } else if (amx_cache_find(&memory->l2, a) >= 0) {
+      memory->bytes_l2 += part;
+    } else {
+      penalty += p->memory_line_cycles;
+      memory->bytes_memory += part;
+    }
+    if (l1 >= 0 && !load) {
+      memory->l1.tags[l1] = 0;
+    }
+    amx_cache_insert(&memory->l2, a);
+  }
+  if (dirty) {
+    double cycles = load ? p->l1_dirty_load_penalty : p->l1_dirty_store_penalty;
+    memory->interference++;
+    memory->interference_cycles += cycles;
+    penalty += cycles;
+  }
+  memory->penalty_cycles += penalty;
+  return penalty;
+}
+
+void amx_memory_print(const struct amx_memory *memory, FILE *file) {
+  fprintf(file,
+          "amx bytes: L1 %llu, L1 dirty %llu, L2 %llu, memory %llu; cpu "
+          "stored %llu B\n",
+          (unsigned long long)memory->bytes_l1,
+          (unsigned long long)memory->bytes_l1_dirty,
+          (unsigned long long)memory->bytes_l2,
+          (unsigned long long)memory->bytes_memory,
+          (unsigned long long)memory->cpu_bytes_stored);
+  fprintf(file,
+          "interference: %llu instructions, %.0f cycles; all memory "
+          "penalties %.0f cycles\n",
+          (unsigned long long)memory->interference,
+          memory->interference_cycles, memory->penalty_cycles);
+}
@@ -0,0 +1,616 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amx.h"
+#include "amx_memory.h"
+
+// cycle approximate timing model of the amx unit, fed one instruction at a
+// time (amx_timing_issue), from the simulator hook or from a trace.
+//
+// instructions are sent in order, at most one per issue_cycles, and at most
+// `window` of them are in flight (the out of order buffer of aarch64_amx.py).
+// an instruction starts when the rows it reads are written (raw), the z rows
+// it writes are written and read by older instructions (waw, war), and its
+// unit is free. units are: memory (loads and stores), fma (fma, mac, vec, mat,
+// genlut) and extr (extrx, extry).
+//
+// defaults come from the notes in aarch64_amx.py:
+//   fma: 4 cycles latency, 1 per cycle if the z rows are independent
+//   0x80 bytes to x and 0x80 bytes to y in 9 cycles: 2.25 cycles per 0x40 row
+//   amx stx loop: 28 cycles per 0x80 bytes store, 14 per row
+//   28 to 32 instructions out of order
+//   cpu str before amx ldx: 47 (93 if aliasing) instead of 9 cycles per loop
+//   cpu str before amx stx: 48 (115 if aliasing) instead of 28 cycles per loop
+// the extr costs and the load latency are guesses.
+//
+// with a memory model (amx_timing_attach_memory, see amx_memory.h) loads and
+// stores also pay for the cache level of their lines, and the cpu store
+// penalty is only the non aliasing one.
+
+struct amx_timing_params {
+  double frequency_ghz;
+  double issue_cycles;
+  int window;
+  double load_row_cycles;
+  double load_latency;
+  double store_row_cycles;
+  double store_latency;
+  double fma_cycles;
+  double fma_latency;
+  double extr_cycles;
+  double extr_latency;
+  double cpu_store_load_penalty;
+  double cpu_store_load_alias_penalty;
+  double cpu_store_store_penalty;
+  double cpu_store_store_alias_penalty;
+};
+
+enum amx_timing_unit {
+  AMX_UNIT_MEMORY = 0,
+  AMX_UNIT_FMA = 1,
+  AMX_UNIT_EXTR = 2,
+  AMX_UNIT_COUNT = 3,
+};
+
+#define AMX_TIMING_MAX_WINDOW 256
+
+// rows of an instruction, z is one bit per z row
+struct amx_timing_rows {
+  uint8_t x;
+  uint8_t y;
+  uint64_t z;
+};
+
+struct amx_timing {
+  struct amx_timing_params params;
+  struct amx_memory *memory; // NULL without a memory model
+
+  // time the last write of a row is done, and the last read of a z row starts
+  double x_ready[8], y_ready[8], z_ready[64];
+  double z_read[64];
+  double unit_free[AMX_UNIT_COUNT];
+  double retire[AMX_TIMING_MAX_WINDOW];
+  double last_issue;
+  double last_retire;
+  double cycles;
+
+  // cpu store before the next amx load or store
+  bool cpu_store;
+  uint64_t cpu_store_begin;
+  uint64_t cpu_store_end;
+
+  // statistics
+  uint64_t instructions;
+  uint64_t ops[AMX_OP_COUNT];
+  uint64_t flops;
+  uint64_t bytes_loaded;
+  uint64_t bytes_stored;
+  double unit_busy[AMX_UNIT_COUNT];
+  double stall_window;     // issue waited for the out of order buffer
+  double stall_dependency; // start waited for a register
+  double stall_unit;       // start waited for a busy unit
+  double stall_cpu_store;  // penalties of cpu stores
+  double stall_memory;     // penalties of the memory model
+};
+
+struct amx_timing_params amx_timing_default_params(void) {
+  struct amx_timing_params params;
+  params.frequency_ghz = 3.2;
+  params.issue_cycles = 1.0;
+  params.window = 28;
+  params.load_row_cycles = 2.25;
+  params.load_latency = 9.0;
+  params.store_row_cycles = 14.0;
+  params.store_latency = 28.0;
+  params.fma_cycles = 1.0;
+  params.fma_latency = 4.0;
+  params.extr_cycles = 1.0;
+  params.extr_latency = 4.0;
+  params.cpu_store_load_penalty = 47.0 - 9.0;
+  params.cpu_store_load_alias_penalty = 93.0 - 9.0;
+  params.cpu_store_store_penalty = 48.0 - 28.0;
+  params.cpu_store_store_alias_penalty = 115.0 - 28.0;
+  return params;
+}
+
+// params NULL for the defaults
+void amx_timing_init(struct amx_timing *timing,
+                     const struct amx_timing_params *params) {
+  memset(timing, 0, sizeof *timing);
+  timing->params = params ? *params : amx_timing_default_params();
+  if (timing->params.window < 1) {
+    timing->params.window = 1;
+  }
+  if (timing->params.window > AMX_TIMING_MAX_WINDOW) {
+    timing->params.window = AMX_TIMING_MAX_WINDOW;
+  }
+}
+
+// rows of 0x40 bytes at a byte offset of x or y, wrapping at 0x200
+static uint8_t amx_timing_xy_rows(uint64_t offset) {
+  offset &= 0x1FF;
+  return (uint8_t)((1u << (offset >> 6)) | (1u << (((offset + 0x3F) >> 6) & 7)));
+}
+
+// z rows (i * stride) + first for i < count
+static uint64_t amx_timing_z_rows(uint64_t first, uint64_t stride,
+                                  uint64_t count) {
+  uint64_t rows = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    rows |= 1ull << ((i * stride + first) & 63);
+  }
+  return rows;
+}
+
+static uint8_t amx_timing_reg_rows(uint64_t operand) {
+  uint64_t reg = (operand >> 56) & 7;
+  uint8_t rows = (uint8_t)(1u << reg);
+  if (operand & (1ull << 62)) {
+    rows |= (uint8_t)(1u << ((reg + 1) & 7));
+  }
+  return rows;
+}
+
+// registers read and written by an instruction, and its flops
+void amx_timing_decode(int op, uint64_t operand, struct amx_timing_rows *read,
+                       struct amx_timing_rows *write, uint64_t *flops) {
+  uint64_t y_offset = operand & 0x1FF;
+  uint64_t x_offset = (operand >> 10) & 0x1FF;
+  uint64_t z_offset = (operand >> 20) & 63;
+  bool vector = operand & (1ull << 63);
+  memset(read, 0, sizeof *read);
+  memset(write, 0, sizeof *write);
+  *flops = 0;
+
+  switch (op) {
+  case AMX_OP_LDX:
+    write->x = amx_timing_reg_rows(operand);
+    break;
+  case AMX_OP_LDY:
+    write->y = amx_timing_reg_rows(operand);
+    break;
+  case AMX_OP_STX:
+    read->x = amx_timing_reg_rows(operand);
+    break;
+  case AMX_OP_STY:
+    read->y = amx_timing_reg_rows(operand);
+    break;
+  case AMX_OP_LDZ:
+  case AMX_OP_STZ: {
+    uint64_t reg = (operand >> 56) & 63;
+    uint64_t rows = 1ull << reg;
+    if (operand & (1ull << 62)) {
+      rows |= 1ull << ((reg + 1) & 63);
+    }
+    if (op == AMX_OP_LDZ) {
+      write->z = rows;
+    } else {
+      read->z = rows;
+    }
+  } break;
+  case AMX_OP_LDZI:
+  case AMX_OP_STZI: {
+    uint64_t reg = (operand >> 56) & 62;
+    if (op == AMX_OP_LDZI) {
+      write->z = 3ull << reg;
+    } else {
+      read->z = 3ull << reg;
+    }
+  } break;
+  case AMX_OP_EXTRX:
+    if (operand & (1ull << 27)) {
+      read->y = (uint8_t)(1u << (z_offset & 7));
+    } else {
+      read->z = 1ull << z_offset;
+    }
+    write->x = amx_timing_xy_rows(x_offset);
+    break;
+  case AMX_OP_EXTRY:
+    if (operand & (1ull << 26)) {
+      read->z = ~0ull;
+      if (operand & (1ull << 10)) {
+        write->y = amx_timing_xy_rows(y_offset);
+      } else {
+        write->x = amx_timing_xy_rows(y_offset);
+      }
+    } else if (operand & (1ull << 27)) {
+      read->x = (uint8_t)(1u << (z_offset & 7));
+      write->y = amx_timing_xy_rows(y_offset);
+    } else {
+      if (operand & (1ull << 29)) {
+        read->z = amx_timing_z_rows(z_offset & 1, 2, 32);
+      } else if (operand & (1ull << 28)) {
+        read->z = amx_timing_z_rows(z_offset & 3, 4, 16);
+      } else {
+        read->z = amx_timing_z_rows(z_offset & 7, 8, 8);
+      }
+      write->y = amx_timing_xy_rows(y_offset);
+    }
+    break;
+  case AMX_OP_FMA64:
+  case AMX_OP_FMS64:
+  case AMX_OP_FMA32:
+  case AMX_OP_FMS32:
+  case AMX_OP_FMA16:
+  case AMX_OP_FMS16:
+  case AMX_OP_MAC16: {
+    uint64_t lanes = op <= AMX_OP_FMS64 ? 8 : op <= AMX_OP_FMS32 ? 16 : 32;
+    if (!(operand & (1ull << 29))) {
+      read->x = amx_timing_xy_rows(x_offset);
+    }
+    if (!(operand & (1ull << 28))) {
+      read->y = amx_timing_xy_rows(y_offset);
+    }
+    if (vector) {
+      write->z = 1ull << z_offset;
+    } else if (lanes == 32 && op != AMX_OP_MAC16 && (operand & (1ull << 62))) {
+      write->z = ~0ull;
+    } else {
+      uint64_t stride = 64 / lanes;
+      write->z = amx_timing_z_rows(z_offset & (stride - 1), stride, lanes);
+    }
+    if (!(operand & (1ull << 27))) {
+      read->z = write->z;
+    }
+    if (op != AMX_OP_MAC16) {
+      *flops = 2 * lanes * (vector ? 1 : lanes);
+    }
+  } break;
+  case AMX_OP_VECINT:
+  case AMX_OP_VECFP:
+    // the simulator's guess: z row += x + y, 32 lanes
+    if (!(operand & (1ull << 29))) {
+      read->x = amx_timing_xy_rows(x_offset);
+    }
+    if (!(operand & (1ull << 28))) {
+      read->y = amx_timing_xy_rows(y_offset);
+    }
+    write->z = 1ull << z_offset;
+    if (!(operand & (1ull << 27))) {
+      read->z = write->z;
+    }
+    if (op == AMX_OP_VECFP) {
+      *flops = 2 * 32;
+    }
+    break;
+  case AMX_OP_MATINT:
+  case AMX_OP_MATFP:
+    // the matrix form of mac16 and fma16
+    amx_timing_decode(op == AMX_OP_MATINT ? AMX_OP_MAC16 : AMX_OP_FMA16,
+                      operand & ~(1ull << 63), read, write, flops);
+    break;
+  case AMX_OP_GENLUT:
+    read->x = 1;
+    write->x = 1;
+    break;
+  default:
+    break;
+  }
+}
+
+static int amx_timing_unit_of(int op) {
+  switch (op) {
+  case AMX_OP_LDX:
+  case AMX_OP_LDY:
+  case AMX_OP_STX:
+  case AMX_OP_STY:
+  case AMX_OP_LDZ:
+  case AMX_OP_STZ:
+  case AMX_OP_LDZI:
+  case AMX_OP_STZI:
+    return AMX_UNIT_MEMORY;
+  case AMX_OP_EXTRX:
+  case AMX_OP_EXTRY:
+    return AMX_UNIT_EXTR;
+  default:
+    return AMX_UNIT_FMA;
+  }
+}
+
+static bool amx_timing_is_load(int op) {
+  return op == AMX_OP_LDX || op == AMX_OP_LDY || op == AMX_OP_LDZ ||
+         op == AMX_OP_LDZI;
+}
+
+// bytes moved by a load or store
+static uint64_t amx_timing_bytes(int op, uint64_t operand) {
+  if (op == AMX_OP_LDZI || op == AMX_OP_STZI) {
+    return 0x40;
+  }
+  return (operand & (1ull << 62)) ? 0x80 : 0x40;
+}
+
+static double amx_timing_max(double a, double b) { return a > b ? a : b; }
+
+// the cpu stored to [address, address + size) before the next amx instruction
+void amx_timing_cpu_store(struct amx_timing *timing, const void *address,
+                          uint64_t size) {
+  uint64_t begin = (uint64_t)address;
+  if (!timing->cpu_store) {
+    timing->cpu_store = true;
+    timing->cpu_store_begin = begin;
+    timing->cpu_store_end = begin + size;
+    return;
+  }
+  if (begin < timing->cpu_store_begin) {
+    timing->cpu_store_begin = begin;
+  }
+  if (begin + size > timing->cpu_store_end) {
+    timing->cpu_store_end = begin + size;
+  }
+}
+
+#define AMX_TIMING_WAIT_ROWS(mask, count, times, wait)                         \
+  for (int r = 0; r < (count); r++) {                                          \
+    if (((mask) >> r) & 1) {                                                   \
+      wait = amx_timing_max(wait, (times)[r]);                                 \
+    }                                                                          \
+  }
+
+#define AMX_TIMING_SET_ROWS(mask, count, times, value, keep_max)               \
+  for (int r = 0; r < (count); r++) {                                          \
+    if (((mask) >> r) & 1) {                                                   \
+      (times)[r] = (keep_max) ? amx_timing_max((times)[r], value) : (value);   \
+    }                                                                          \
+  }
+
+void amx_timing_issue(struct amx_timing *timing, int op, uint64_t operand) {
+  const struct amx_timing_params *p = &timing->params;
+  if (op == AMX_OP_START_STOP || op < 0 || op >= AMX_OP_COUNT) {
+    return;
+  }
+
+  struct amx_timing_rows read, write;
+  uint64_t flops;
+  amx_timing_decode(op, operand, &read, &write, &flops);
+  int unit = amx_timing_unit_of(op);
+
+  // in order issue, limited by the out of order buffer
+  int slot = (int)(timing->instructions % (uint64_t)p->window);
+  double issue = timing->instructions ? timing->last_issue + p->issue_cycles : 0;
+  if (timing->instructions >= (uint64_t)p->window &&
+      timing->retire[slot] > issue) {
+    timing->stall_window += timing->retire[slot] - issue;
+    issue = timing->retire[slot];
+  }
+
+  double ready = issue;
+  AMX_TIMING_WAIT_ROWS(read.x, 8, timing->x_ready, ready);
+  AMX_TIMING_WAIT_ROWS(read.y, 8, timing->y_ready, ready);
+  AMX_TIMING_WAIT_ROWS(read.z, 64, timing->z_ready, ready);
+  // x and y are renamed: the loop of aarch64_amx.py reloads x0 and y0 every
+  // 9 cycles while the fmas of the previous iteration still read them
+  AMX_TIMING_WAIT_ROWS(write.z, 64, timing->z_ready, ready);
+  AMX_TIMING_WAIT_ROWS(write.z, 64, timing->z_read, ready);
+
+  double start = amx_timing_max(ready, timing->unit_free[unit]);
+  timing->stall_dependency += ready - issue;
+  timing->stall_unit += start - ready;
+
+  double busy, latency;
+  if (unit == AMX_UNIT_MEMORY) {
+    uint64_t bytes = amx_timing_bytes(op, operand);
+    uint64_t rows = bytes / 0x40;
+    bool load = amx_timing_is_load(op);
+    busy = (load ? p->load_row_cycles : p->store_row_cycles) * rows;
+    latency = load ? p->load_latency : p->store_latency;
+    if (timing->cpu_store) {
+      uint64_t begin = operand & ((1ull << 56) - 1);
+      // the memory model knows the lines the cpu stored
+      bool alias = !timing->memory && begin < timing->cpu_store_end &&
+                   begin + bytes > timing->cpu_store_begin;
+      double penalty = load ? (alias ? p->cpu_store_load_alias_penalty
+                                     : p->cpu_store_load_penalty)
+                            : (alias ? p->cpu_store_store_alias_penalty
+                                     : p->cpu_store_store_penalty);
+      start += penalty;
+      timing->stall_cpu_store += penalty;
+      timing->cpu_store = false;
+    }
+    if (timing->memory) {
+      double penalty = amx_memory_access(
+          timing->memory, load, operand & ((1ull << 56) - 1), bytes);
+      start += penalty;
+      timing->stall_memory += penalty;
+    }
+    if (load) {
+      timing->bytes_loaded += bytes;
+    } else {
+      timing->bytes_stored += bytes;
+    }
+  } else if (unit == AMX_UNIT_FMA) {
+    busy = p->fma_cycles;
+    latency = p->fma_latency;
+  } else {
+    busy = p->extr_cycles;
+    latency = p->extr_latency;
+  }
+  latency = amx_timing_max(latency, busy);
+
+  double done = start + latency;
+  timing->unit_free[unit] = start + busy;
+  timing->unit_busy[unit] += busy;
+
+  AMX_TIMING_SET_ROWS(write.x, 8, timing->x_ready, done, false);
+  AMX_TIMING_SET_ROWS(write.y, 8, timing->y_ready, done, false);
+  AMX_TIMING_SET_ROWS(write.z, 64, timing->z_ready, done, false);
+  AMX_TIMING_SET_ROWS(read.z, 64, timing->z_read, start, true);
+
+  timing->last_retire = amx_timing_max(timing->last_retire, done);
+  timing->retire[slot] = timing->last_retire;
+  timing->last_issue = issue;
+  timing->cycles = amx_timing_max(timing->cycles, done);
+  timing->instructions++;
+  timing->ops[op]++;
+  timing->flops += flops;
+}
+
+double amx_timing_seconds(const struct amx_timing *timing) {
+  return timing->cycles / (timing->params.frequency_ghz * 1e9);
+}
+
+double amx_timing_gflops(const struct amx_timing *timing) {
+  if (timing->cycles <= 0) {
+    return 0;
+  }
+  return timing->flops * timing->params.frequency_ghz / timing->cycles;
+}
+
+void amx_timing_print(const struct amx_timing *timing, FILE *file) {
+  static const char *unit_names[AMX_UNIT_COUNT] = {"memory", "fma", "extr"};
+  double cycles = timing->cycles > 0 ? timing->cycles : 1;
+  fprintf(file, "cycles %.0f (%.3f ms at %.2f GHz), %.3f GFLOP/s\n",
+          timing->cycles, amx_timing_seconds(timing) * 1e3,
+          timing->params.frequency_ghz, amx_timing_gflops(timing));
+  fprintf(file, "instructions %llu, flops %llu, loaded %llu B, stored %llu B\n",
+          (unsigned long long)timing->instructions,
+          (unsigned long long)timing->flops,
+          (unsigned long long)timing->bytes_loaded,
+          (unsigned long long)timing->bytes_stored);
+  for (int u = 0; u < AMX_UNIT_COUNT; u++) {
+    fprintf(file, "%-6s busy %5.1f%%\n", unit_names[u],
+            100.0 * timing->unit_busy[u] / cycles);
+  }
+  fprintf(file,
+          "stalls: window %.0f, dependency %.0f, unit %.0f, cpu store %.0f, "
+          "memory %.0f\n",
+          timing->stall_window, timing->stall_dependency, timing->stall_unit,
+          timing->stall_cpu_store, timing->stall_memory);
+}
+
+#ifdef AMX_SIMULATOR
+
+// a model per thread, restarted by AMX_START. AMX_STOP keeps the run in
+// amx_timing_last and prints it if $AMX_TIMING is set.
+//
+// with amx_timing_enable_memory (or $AMX_MEMORY) every thread also has a
+// memory model, kept across runs and freed when the thread exits, and
+// AMX_NOTE_CPU_STORE reaches it. the statistics of a run are the ones since
+// the previous AMX_STOP, so they count the packing before AMX_START.
+
+static __thread struct amx_timing amx_timing_thread;
+static __thread struct amx_timing amx_timing_last;
+static __thread struct amx_memory *amx_timing_memory_thread;
+static __thread struct amx_memory amx_timing_memory_last;
+static struct amx_timing_params amx_timing_sim_params;
+static struct amx_memory_params amx_timing_memory_params;
+static bool amx_timing_sim_enabled = false;
+static bool amx_timing_memory_enabled = false;
+static bool amx_timing_sim_print = false;
+
+// the memory model of a thread is freed when the thread exits
+static pthread_key_t amx_timing_memory_key;
+static pthread_once_t amx_timing_memory_once = PTHREAD_ONCE_INIT;
+
+static void amx_timing_memory_destroy(void *memory) {
+  amx_memory_free((struct amx_memory *)memory);
+  free(memory);
+}
+
+static void amx_timing_memory_key_init(void) {
+  pthread_key_create(&amx_timing_memory_key, amx_timing_memory_destroy);
+}
+
+// the memory model of this thread, NULL if disabled
+struct amx_memory *amx_timing_memory(void) {
+  if (!amx_timing_memory_enabled) {
+    return NULL;
+  }
+  if (amx_timing_memory_thread == NULL) {
+    struct amx_memory *memory = (struct amx_memory *)malloc(sizeof *memory);
+    if (memory && amx_memory_init(memory, &amx_timing_memory_params)) {
+      free(memory);
+      memory = NULL;
+    }
+    if (memory) {
+      pthread_once(&amx_timing_memory_once, amx_timing_memory_key_init);
+      pthread_setspecific(amx_timing_memory_key, memory);
+    }
+    amx_timing_memory_thread = memory;
+  }
+  return amx_timing_memory_thread;
+}
+
+static void amx_timing_hook(void *context, int op, uint64_t operand) {
+  (void)context;
+  if (op == AMX_OP_START_STOP) {
+    if (operand == 0) {
+      amx_timing_init(&amx_timing_thread, &amx_timing_sim_params);
+      amx_timing_thread.memory = amx_timing_memory();
+    } else {
+      amx_timing_last = amx_timing_thread;
+      struct amx_memory *memory = amx_timing_thread.memory;
+      if (memory) {
+        amx_timing_memory_last = *memory;
+        amx_memory_reset_stats(memory);
+      }
+      if (amx_timing_sim_print) {
+        amx_timing_print(&amx_timing_last, stderr);
+        if (memory) {
+          amx_memory_print(&amx_timing_memory_last, stderr);
+        }
+      }
+    }
+    return;
+  }
+  amx_timing_issue(&amx_timing_thread, op, operand);
+}
+
+void amx_sim_note_cpu_store(const void *address, uint64_t size) {
+  if (!amx_timing_sim_enabled) {
+    return;
+  }
+  amx_timing_cpu_store(&amx_timing_thread, address, size);
+  struct amx_memory *memory = amx_timing_memory();
+  if (memory) {
+    amx_memory_cpu_store(memory, address, size);
+  }
+}
+
+// params NULL for the defaults
+void amx_timing_enable(const struct amx_timing_params *params) {
+  amx_timing_sim_params = params ? *params : amx_timing_default_params();
+  amx_remove_hook(amx_timing_hook, NULL);
+  amx_add_hook(amx_timing_hook, NULL);
+  amx_timing_sim_enabled = true;
+}
+
+void amx_timing_disable(void) {
+  amx_remove_hook(amx_timing_hook, NULL);
+  amx_timing_sim_enabled = false;
+}
+
+// from the next AMX_START, params NULL for the defaults. threads that already
+// have a memory model keep theirs.
+void amx_timing_enable_memory(const struct amx_memory_params *params) {
+  amx_timing_memory_params = params ? *params : amx_memory_default_params();
+  amx_timing_memory_enabled = true;
+}
+
+void amx_timing_disable_memory(void) { amx_timing_memory_enabled = false; }
+
+// the last AMX_START/AMX_STOP run of this thread
+const struct amx_timing *amx_timing_last_run(void) { return &amx_timing_last; }
+
+// memory statistics of the last run of this thread, NULL without a model
+const struct amx_memory *amx_timing_last_memory(void) {
+  return amx_timing_last.memory ? &amx_timing_memory_last : NULL;
+}
+
+__attribute__((constructor)) static void amx_timing_sim_init(void) {
+  if (getenv("AMX_MEMORY")) {
+    amx_timing_enable_memory(NULL);
+  }
+  if (getenv("AMX_TIMING")) {
+    amx_timing_sim_print = true;
+    amx_timing_enable(NULL);
+  }
+}
+
+#endif
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "amx.h"
+
+// binary traces of amx instructions
+//
+// file: a header, then records. a load or store record is followed by the
+// memory it read or wrote (0x40 or 0x80 bytes, after the instruction ran), so a
+// trace replays on any machine, and replaying a trace recorded on hardware
+// checks the simulator against the stores of the hardware.
+//
+// recording: build with -DAMX_SIMULATOR, or -DAMX_TRACE on hardware, and call
+// amx_trace_enable(path) or set $AMX_TRACE=path. each thread writes its own
+// file, path.0, path.1, ... in the order threads first issue an instruction.
+// writes are buffered, files are closed at exit or by amx_trace_disable.
+//
+// reading: amx_trace_map maps a file, amx_trace_next walks the records and
+// amx_trace_replay runs them on a simulator state (needs simulator.h).
+
+#define AMX_TRACE_MAGIC "AMXTRACE"
+#define AMX_TRACE_VERSION 1
+#define AMX_TRACE_BUFFER (1 << 20)
+#define AMX_TRACE_MAX_THREADS 64
+
+struct amx_trace_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+};
+
+struct amx_trace_record {
+  uint64_t operand; // as issued, with the original address
+  uint32_t size;    // bytes of memory following the record
+  uint8_t op;
+  uint8_t reserved[3];
+};
+
+// bytes of memory read or written by an instruction, 0 if none
+static uint32_t amx_trace_memory_size(int op, uint64_t operand) {
+  switch (op) {
+  case AMX_OP_LDX:
+  case AMX_OP_LDY:
+  case AMX_OP_STX:
+  case AMX_OP_STY:
+  case AMX_OP_LDZ:
+  case AMX_OP_STZ:
+    return (operand & (1ull << 62)) ? 0x80 : 0x40;
+  case AMX_OP_LDZI:
+  case AMX_OP_STZI:
+    return 0x40;
+  default:
+    return 0;
+  }
+}
+
+static bool amx_trace_is_store(int op) {
+  return op == AMX_OP_STX || op == AMX_OP_STY || op == AMX_OP_STZ ||
+         op == AMX_OP_STZI;
+}
+
+struct amx_trace_writer {
+  FILE *file;
+  char *buffer;
+  uint64_t records;
+};
+
+// return 0 on success
+int amx_trace_open(struct amx_trace_writer *writer, const char *path) {
+  struct amx_trace_header header;
+  memset(writer, 0, sizeof *writer);
+  writer->file = fopen(path, "wb");
+  if (writer->file == NULL) {
+    return -1;
+  }
+  writer->buffer = (char *)malloc(AMX_TRACE_BUFFER);
+  if (writer->buffer) {
+    setvbuf(writer->file, writer->buffer, _IOFBF, AMX_TRACE_BUFFER);
+  }
+  memcpy(header.magic, AMX_TRACE_MAGIC, sizeof header.magic);
+  header.version = AMX_TRACE_VERSION;
+  header.record_size = sizeof(struct amx_trace_record);
+  fwrite(&header, sizeof header, 1, writer->file);
+  return 0;
+}
+
+// after the instruction ran, so stored memory is the result
+void amx_trace_write(struct amx_trace_writer *writer, int op,
+                     uint64_t operand) {
+  struct amx_trace_record record;
+  memset(&record, 0, sizeof record);
+  record.operand = operand;
+  record.op = (uint8_t)op;
+  record.size = amx_trace_memory_size(op, operand);
+  fwrite(&record, sizeof record, 1, writer->file);
+  if (record.size) {
+    fwrite((const void *)(operand & ((1ull << 56) - 1)), 1, record.size,
+           writer->file);
+  }
+  writer->records++;
+}
+
+// return 0 on success
+int amx_trace_close(struct amx_trace_writer *writer) {
+  int result = 0;
+  if (writer->file) {
+    result = fclose(writer->file);
+  }
+  free(writer->buffer);
+  memset(writer, 0, sizeof *writer);
+  return result;
+}
+
+struct amx_trace_reader {
+  const uint8_t *data;
+  size_t size;
+  size_t offset;
+};
+
+// return 0 on success
+int amx_trace_map(struct amx_trace_reader *reader, const char *path) {
+  struct stat st;
+  struct amx_trace_header header;
+  memset(reader, 0, sizeof *reader);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  if (fstat(fd, &st) || (size_t)st.st_size < sizeof header) {
+    close(fd);
+    return -1;
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+  memcpy(&header, data, sizeof header);
+  if (memcmp(header.magic, AMX_TRACE_MAGIC, sizeof header.magic) ||
+      header.version != AMX_TRACE_VERSION ||
+      header.record_size != sizeof(struct amx_trace_record)) {
+    munmap(data, st.st_size);
+    return -1;
+  }
+  reader->data = (const uint8_t *)data;
+  reader->size = st.st_size;
+  reader->offset = sizeof header;
+  return 0;
+}
+
+// return 1 with the next record and its memory, 0 at the end, -1 if truncated
+int amx_trace_next(struct amx_trace_reader *reader,
+                   struct amx_trace_record *record, const uint8_t **memory) {
+  if (reader->offset == reader->size) {
+    return 0;
+  }
+  if (reader->size - reader->offset < sizeof *record) {
+    return -1;
+  }
+  memcpy(record, reader->data + reader->offset, sizeof *record);
+  reader->offset += sizeof *record;
+  if (record->size > reader->size - reader->offset ||
+      record->size != amx_trace_memory_size(record->op, record->operand)) {
+    return -1;
+  }
+  *memory = reader->data + reader->offset;
+  reader->offset += record->size;
+  return 1;
+}
+
+void amx_trace_rewind(struct amx_trace_reader *reader) {
+  reader->offset = sizeof(struct amx_trace_header);
+}
+
+void amx_trace_unmap(struct amx_trace_reader *reader) {
+  if (reader->data) {
+    munmap((void *)reader->data, reader->size);
+  }
+  memset(reader, 0, sizeof *reader);
+}
+
+#if defined(AMX_SIMULATOR) || defined(AMX_TRACE)
+
+static char amx_trace_path[4096];
+static struct amx_trace_writer *amx_trace_writers[AMX_TRACE_MAX_THREADS];
+static int amx_trace_writer_count = 0;
+static pthread_mutex_t amx_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+// bumped by amx_trace_disable, the writer of a thread is only valid in the
+// generation it was opened in
+static uint64_t amx_trace_generation = 0;
+static __thread struct amx_trace_writer *amx_trace_thread;
+static __thread int amx_trace_thread_full;
+static __thread uint64_t amx_trace_thread_generation;
+
+static struct amx_trace_writer *amx_trace_thread_writer(void) {
+  uint64_t generation =
+      __atomic_load_n(&amx_trace_generation, __ATOMIC_ACQUIRE);
+  if (amx_trace_thread_generation != generation) {
+    amx_trace_thread = NULL; // freed by amx_trace_disable
+    amx_trace_thread_full = 0;
+    amx_trace_thread_generation = generation;
+  }
+  if (amx_trace_thread || amx_trace_thread_full) {
+    return amx_trace_thread;
+  }
+  pthread_mutex_lock(&amx_trace_lock);
+  if (amx_trace_writer_count < AMX_TRACE_MAX_THREADS) {
+    char path[4096 + 16];
+    struct amx_trace_writer *writer =
+        (struct amx_trace_writer *)malloc(sizeof *writer);
+    snprintf(path, sizeof path, "%s.%d", amx_trace_path,
+             amx_trace_writer_count);
+    if (writer && amx_trace_open(writer, path) == 0) {
+      amx_trace_writers[amx_trace_writer_count++] = writer;
+      amx_trace_thread = writer;
+    } else {
+      fprintf(stderr, "amx trace: can not write %s\n", path);
+      free(writer);
+    }
+  }
+  amx_trace_thread_full = amx_trace_thread == NULL;
+  amx_trace_thread_generation = amx_trace_generation;
+  pthread_mutex_unlock(&amx_trace_lock);
+  return amx_trace_thread;
+}
+
+static void amx_trace_hook(void *context, int op, uint64_t operand) {
+  (void)context;
+  struct amx_trace_writer *writer = amx_trace_thread_writer();
+  if (writer) {
+    amx_trace_write(writer, op, operand);
+  }
+}
+
+// close the files of all threads, the threads should not use amx any more
+void amx_trace_disable(void) {
+  amx_remove_hook(amx_trace_hook, NULL);
+  pthread_mutex_lock(&amx_trace_lock);
+  for (int i = 0; i < amx_trace_writer_count; i++) {
+    amx_trace_close(amx_trace_writers[i]);
+    free(amx_trace_writers[i]);
+  }
+  amx_trace_writer_count = 0;
+  __atomic_add_fetch(&amx_trace_generation, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&amx_trace_lock);
+}
+
+// record the instructions of every thread to path.0, path.1, ...
+void amx_trace_enable(const char *path) {
+  amx_trace_disable();
+  snprintf(amx_trace_path, sizeof amx_trace_path, "%s", path);
+  amx_add_hook(amx_trace_hook, NULL);
+}
+
+static void amx_trace_exit(void) { amx_trace_disable(); }
+
+__attribute__((constructor)) static void amx_trace_init(void) {
+  const char *path = getenv("AMX_TRACE");
+  if (path) {
+    amx_trace_enable(path);
+  }
+  atexit(amx_trace_exit);
+}
+
+#endif
+
+#ifdef AMX_SIMULATOR
+
+struct amx_trace_replay_stats {
+  uint64_t records;
+  uint64_t loads;
+  uint64_t stores;
+  uint64_t store_mismatches; // stores that differ from the recorded memory
+  uint64_t first_mismatch;   // record index of the first one
+};
+
+// run every record on state. loads read the recorded memory and stores are
+// compared to it. hook, if not NULL, sees every record after it ran.
+// return 0 at the end of the trace, -1 if it is truncated.
+int amx_trace_replay(struct amx_trace_reader *reader, struct amx_state *state,
+                     struct amx_trace_replay_stats *stats, amx_hook_fn hook,
+                     void *context) {
+  union amx_row buffer[2] __attribute__((aligned(128)));
+  struct amx_trace_record record;
+  const uint8_t *memory;
+  int result;
+  memset(stats, 0, sizeof *stats);
+  while ((result = amx_trace_next(reader, &record, &memory)) == 1) {
+    uint64_t operand = record.operand;
+    if (record.size) {
+      // same register and flags, the address is the local buffer
+      operand = (operand & ~((1ull << 56) - 1)) | (uint64_t)buffer;
+      memcpy(buffer, memory, record.size);
+    }
+    if (record.op == AMX_OP_START_STOP) {
+      if (record.operand == 0) {
+        amx_state_zero(state);
+      }
+    } else {
+      amx_state_execute(state, record.op, operand);
+    }
+    if (record.size && amx_trace_is_store(record.op)) {
+      if (memcmp(buffer, memory, record.size)) {
+        if (stats->store_mismatches++ == 0) {
+          stats->first_mismatch = stats->records;
+        }
+      }
+      stats->stores++;
+    } else if (record.size) {
+      stats->loads++;
+    }
+    if (hook) {
+      hook(context, record.op, record.operand);
+    }
+    stats->records++;
+  }
+  return result;
+}
+
+#endif
@@ -1,14 +1,16 @@
 #include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "amx.h"
 #include "simulator.h"
 
 static int check_state(struct amx_state *sim_state, int flags) {
-  __attribute__((aligned(0x80))) static struct amx_state state;
+  __attribute__((aligned(0x80))) struct amx_state state;
 
   store_amx_state(&state);
   if (memcmp(sim_state, &state, sizeof state)) {
@@ -56,6 +58,32 @@ static void test_start(struct amx_state *sim_state) {
 
 static void test_stop(struct amx_state *sim_state) { AMX_STOP(); }
 
+// row and column disable fields (bits 32-38 and 41-47) of the fma and mac ops,
+// every pair of values in matrix and vector mode, with and without z input.
+// modes with bits of skip are left out
+static const uint64_t disable_values[] = {0,    1,    2,    3,    0x20, 0x23,
+                                          0x3F, 0x40, 0x45, 0x5F, 0x60, 0x62,
+                                          0x65, 0x7F};
+
+static void test_disable(void (*test)(void *, uint64_t), void *data,
+                         uint64_t flags, uint64_t skip) {
+  static const uint64_t modes[] = {0, 1ull << 27, 1ull << 63,
+                                   (1ull << 63) | (1ull << 27),
+                                   (1ull << 20) | (0x40 << 10) | 0x40};
+  uint64_t count = sizeof disable_values / sizeof disable_values[0];
+  for (uint64_t m = 0; m < sizeof modes / sizeof modes[0]; m++) {
+    if (modes[m] & skip) {
+      continue;
+    }
+    for (uint64_t r = 0; r < count; r++) {
+      for (uint64_t c = 0; c < count; c++) {
+        test(data, flags | modes[m] | (disable_values[r] << 32) |
+                       (disable_values[c] << 41));
+      }
+    }
+  }
+}
+
 // LDX/LDY/LDZ/LDZI
 
 static void test_ldx(struct amx_state *sim_state, uint64_t op) {
@@ -83,7 +111,7 @@ static void test_ldzi(struct amx_state *sim_state, uint64_t op) {
 }
 
 static void test_loads(void) {
-  __attribute__((aligned(0x80))) static float test_data[(8 + 8 + 64) * 16];
+  __attribute__((aligned(0x80))) float test_data[(8 + 8 + 64) * 16];
 
   init_test_f32s(test_data);
 
@@ -123,11 +151,11 @@ static void test_loads(void) {
 
 static void test_stores(void) {
   struct amx_state sim_state;
-  static float test_data[(8 + 8 + 64) * 16];
+  float test_data[(8 + 8 + 64) * 16];
   init_test_f32s(test_data);
 
-  __attribute__((aligned(0x80))) static float store_buffer1[0x100];
-  __attribute__((aligned(0x80))) static float store_buffer2[0x100];
+  __attribute__((aligned(0x80))) float store_buffer1[0x100];
+  __attribute__((aligned(0x80))) float store_buffer2[0x100];
 
   test_start(&sim_state);
   memcpy(&sim_state, test_data, sizeof sim_state);
@@ -429,11 +457,11 @@ static void fms32_test(void *initial_state, uint64_t operand) {
 }
 
 static void test_fma32_fms32(void) {
-  static float test_data[(8 + 8 + 64) * 16];
+  float test_data[(8 + 8 + 64) * 16];
   init_test_f32s(test_data);
 
   // slow, but passes
-  // TODO: fields at bit 32/41/60
+  // TODO: fields at bit 60
   // uint64_t mask = 0xa000da4f3bf709f8 & ~((0x3Full << 32) | (0x3Full << 41) |
   // (0x3ull << 60));
 
@@ -456,21 +484,21 @@ static void test_fma32_fms32(void) {
   for (int i = 0; i < 32; i++) {
     fma32_test(test_data, (1ull << i));
   }
-  // fma32_test(test_data, (1ull << 32));
-  // fma32_test(test_data, (1ull << 33));
-  // fma32_test(test_data, (1ull << 34));
-  // fma32_test(test_data, (1ull << 35));
-  // fma32_test(test_data, (1ull << 36));
-  // fma32_test(test_data, (1ull << 37));
+  fma32_test(test_data, (1ull << 32));
+  fma32_test(test_data, (1ull << 33));
+  fma32_test(test_data, (1ull << 34));
+  fma32_test(test_data, (1ull << 35));
+  fma32_test(test_data, (1ull << 36));
+  fma32_test(test_data, (1ull << 37));
   fma32_test(test_data, (1ull << 38));
   fma32_test(test_data, (1ull << 39));
   fma32_test(test_data, (1ull << 40));
-  // fma32_test(test_data, (1ull << 41));
-  // fma32_test(test_data, (1ull << 42));
-  // fma32_test(test_data, (1ull << 43));
-  // fma32_test(test_data, (1ull << 44));
-  // fma32_test(test_data, (1ull << 45));
-  // fma32_test(test_data, (1ull << 46));
+  fma32_test(test_data, (1ull << 41));
+  fma32_test(test_data, (1ull << 42));
+  fma32_test(test_data, (1ull << 43));
+  fma32_test(test_data, (1ull << 44));
+  fma32_test(test_data, (1ull << 45));
+  fma32_test(test_data, (1ull << 46));
   fma32_test(test_data, (1ull << 47));
   fma32_test(test_data, (1ull << 48));
   fma32_test(test_data, (1ull << 49));
@@ -488,6 +516,9 @@ static void test_fma32_fms32(void) {
   // fma32_test(test_data, (1ull << 61));
   fma32_test(test_data, (1ull << 62));
   fma32_test(test_data, (1ull << 63));
+
+  test_disable(fma32_test, test_data, 0, 0);
+  test_disable(fms32_test, test_data, 0, 0);
 }
 
 // FMA64/FMS64
@@ -536,7 +567,7 @@ static void fms64_test(void *initial_state, uint64_t operand) {
 }
 
 static void test_fma64_fms64(void) {
-  static double test_data[(8 + 8 + 64) * 8];
+  double test_data[(8 + 8 + 64) * 8];
 
   init_test_f64s(test_data);
 
@@ -559,6 +590,8 @@ static void test_fma64_fms64(void) {
     // ryg's texture tiling and swizzling loop
     operand = (operand - mask) & mask;
   } while (operand);
+  test_disable(fma64_test, test_data, 0, 0);
+  test_disable(fms64_test, test_data, 0, 0);
 }
 
 // FMA16/FMS16
@@ -618,7 +651,7 @@ static void test_fma16_fms16(void) {
   // TODO: There's something wrong with NaN accuracy - probably in the others as
   // well but it shows up here if we let offset_mask be odd.
 
-  static float16 test_data[(8 + 8 + 64) * 32];
+  float16 test_data[(8 + 8 + 64) * 32];
 
   init_test_f16s(test_data);
 
@@ -636,6 +669,10 @@ static void test_fma16_fms16(void) {
     // ryg's texture tiling and swizzling loop
     operand = (operand - mask) & mask;
   } while (operand);
+  test_disable(fma16_test, test_data, 0, 0);
+  test_disable(fma16_test, test_data, 1ull << 62, 0);
+  test_disable(fms16_test, test_data, 0, 0);
+  test_disable(fms16_test, test_data, 1ull << 62, 0);
 }
 
 // MAC16
@@ -670,7 +707,7 @@ static void init_test_u16s(uint16_t *test) {
 }
 
 static void test_mac16(void) {
-  static uint16_t test_data[(8 + 8 + 64) * 32];
+  uint16_t test_data[(8 + 8 + 64) * 32];
 
   init_test_u16s(test_data);
 
@@ -682,9 +719,127 @@ static void test_mac16(void) {
     mac16_test(test_data, operand);
     operand = (operand - mask) & mask;
   } while (operand);
+  test_disable(mac16_test, test_data, 0, 0);
+  test_disable(mac16_test, test_data, 1ull << 62, 0);
 }
 
-int main(int argc, char **argv) {
+// VECINT/VECFP/MATINT/MATFP: the simulator implements the guesses of
+// aarch64_amx.py (see simulator.h), these check them
+
+static void vec_mat_test(int op, void *initial_state, uint64_t operand) {
+  struct amx_state sim_state;
+
+  test_start(&sim_state);
+  memcpy(&sim_state, initial_state, sizeof sim_state);
+  load_amx_state(&sim_state);
+
+  switch (op) {
+  case AMX_OP_VECINT: AMX_VECINT(operand); break;
+  case AMX_OP_VECFP: AMX_VECFP(operand); break;
+  case AMX_OP_MATINT: AMX_MATINT(operand); break;
+  case AMX_OP_MATFP: AMX_MATFP(operand); break;
+  }
+  amx_state_execute(&sim_state, op, operand);
+  if (!check_state(&sim_state, PF_U16)) {
+    printf("^ op %d %llx\n\n", op, operand);
+  }
+
+  test_stop(&sim_state);
+}
+
+static void vecint_test(void *initial_state, uint64_t operand) {
+  vec_mat_test(AMX_OP_VECINT, initial_state, operand);
+}
+
+static void vecfp_test(void *initial_state, uint64_t operand) {
+  vec_mat_test(AMX_OP_VECFP, initial_state, operand);
+}
+
+static void matint_test(void *initial_state, uint64_t operand) {
+  vec_mat_test(AMX_OP_MATINT, initial_state, operand);
+}
+
+static void matfp_test(void *initial_state, uint64_t operand) {
+  vec_mat_test(AMX_OP_MATFP, initial_state, operand);
+}
+
+static void test_vec_mat(void) {
+  uint16_t int_data[(8 + 8 + 64) * 32];
+  float16 fp_data[(8 + 8 + 64) * 32];
+
+  init_test_u16s(int_data);
+  init_test_f16s(fp_data);
+
+  uint64_t offset_mask = 0x101; // optimised - thorough is 0x1FF
+  uint64_t mask = (1ull << 27) | (1ull << 28) | (1ull << 29) | (63 << 20) |
+                  (offset_mask << 10) | offset_mask;
+  uint64_t operand = 0;
+  do {
+    vecint_test(int_data, operand);
+    vecfp_test(fp_data, operand);
+    matint_test(int_data, operand);
+    matint_test(int_data, operand | (1ull << 62));
+    matfp_test(fp_data, operand);
+    matfp_test(fp_data, operand | (1ull << 62));
+    operand = (operand - mask) & mask;
+  } while (operand);
+  test_disable(vecint_test, int_data, 0, 1ull << 63);
+  test_disable(vecfp_test, fp_data, 0, 1ull << 63);
+  test_disable(matint_test, int_data, 0, 1ull << 63);
+  test_disable(matfp_test, fp_data, 0, 1ull << 63);
+}
+
+// GENLUT: with xzr, x[0] is both the values and the table
+
+static void genlut_test(const int32_t *table) {
+  struct amx_state sim_state;
+
+  test_start(&sim_state);
+  memcpy(&sim_state.x[0], table, 0x40);
+  load_amx_state(&sim_state);
+
+  AMX_GENLUT(0);
+  amx_state_genlut(&sim_state, 0);
+  if (!check_state(&sim_state, PF_U32)) {
+    printf("^ genlut %llx\n\n", (unsigned long long)sim_state.x[0].u64[0]);
+  }
+
+  test_stop(&sim_state);
+}
+
+static void test_genlut(void) {
+  int32_t table[16];
+
+  // the three examples of aarch64_amx.py
+  for (int i = 0; i < 16; i++) {
+    table[i] = 15 - i;
+  }
+  genlut_test(table);
+  table[0] = 0;
+  for (int i = 1; i < 16; i++) {
+    table[i] = 16 - i;
+  }
+  genlut_test(table);
+  for (int i = 0; i < 16; i++) {
+    table[i] = i;
+  }
+  genlut_test(table);
+
+  // repeated and negative entries, and unsorted tables
+  for (int seed = 0; seed < 64; seed++) {
+    for (int i = 0; i < 16; i++) {
+      table[i] = (int32_t)((i * 7 + seed * 13) % 11) - 5;
+    }
+    genlut_test(table);
+    for (int i = 0; i < 16; i++) {
+      table[i] = (i * 3 + seed) / 4 - 8;
+    }
+    genlut_test(table);
+  }
+}
+
+static void *run_tests(void *arg) {
+  (void)arg;
   // TODO: test stores
   test_loads();
   test_stores();
@@ -694,6 +849,26 @@ int main(int argc, char **argv) {
   test_fma64_fms64();
   test_extrx();
   test_extry();
+  test_vec_mat();
+  test_genlut();
+  return NULL;
+}
 
+// ./hwtest [threads]: every thread runs the tests at the same time, with its
+// own amx context
+int main(int argc, char **argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 1;
+  if (count <= 1) {
+    run_tests(NULL);
+    return 0;
+  }
+  pthread_t *threads = (pthread_t *)malloc(count * sizeof(pthread_t));
+  for (int i = 0; i < count; i++) {
+    pthread_create(&threads[i], NULL, run_tests, NULL);
+  }
+  for (int i = 0; i < count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
   return 0;
 }
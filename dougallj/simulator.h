@@ -1,9 +1,12 @@
 #pragma once
 
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "amx.h"
@@ -44,16 +47,28 @@ float16 fma16(float16 a, float16 b, float16 c) {
 
 #else
 
-#error "TODO: portable fma64/fma32/fma16 implementations"
+// portable versions, fma/fmaf are single rounding like fmadd
 
-float fma32(float a, float b, float c) {
-#pragma clang fp contract(fast)
-  return a * b + c;
-}
+double fma64(double a, double b, double c) { return fma(a, b, c); }
 
-double fma64(double a, double b, double c) {
-#pragma clang fp contract(fast)
-  return a * b + c;
+float fma32(float a, float b, float c) { return fmaf(a, b, c); }
+
+float fms32(float a, float b, float c) { return fmaf(-a, b, c); }
+
+// a * b is exact in double, a + b is rounded to odd so that the rounding to
+// half precision is the same as a single rounding of a * b + c
+float16 fma16(float16 a, float16 b, float16 c) {
+  double product = (double)a * (double)b;
+  double sum = product + (double)c;
+  double rest = sum - product;
+  double error = (product - (sum - rest)) + ((double)c - rest);
+  uint64_t bits;
+  memcpy(&bits, &sum, sizeof bits);
+  if (error != 0 && isfinite(sum) && (bits & 1) == 0) {
+    bits += ((error > 0) == (sum > 0)) ? 1 : -1;
+    memcpy(&sum, &bits, sizeof sum);
+  }
+  return (float16)sum;
 }
 
 #endif
@@ -148,6 +163,10 @@ void amx_state_stzi(struct amx_state *state, uint64_t operand) {
   memcpy(addr, row, sizeof row);
 }
 
+#ifdef AMX_SIM_SCALAR
+
+// reference versions, byte by byte with the wrap around of every byte
+
 static void load_from_x(void *output, struct amx_state *state, size_t offset,
                         size_t size) {
   char *p = (char *)output;
@@ -188,9 +207,222 @@ static void store_to_y(void *output, struct amx_state *state, size_t offset,
   }
 }
 
+#else
+
+// the register file is at least 0x40 bytes, so a copy wraps around at most once
+static void amx_sim_copy_from(void *output, const char *base, size_t mask,
+                              size_t offset, size_t size) {
+  size_t start = offset & mask;
+  size_t first = size < mask + 1 - start ? size : mask + 1 - start;
+  memcpy(output, base + start, first);
+  memcpy((char *)output + first, base, size - first);
+}
+
+static void amx_sim_copy_to(char *base, const void *input, size_t mask,
+                            size_t offset, size_t size) {
+  size_t start = offset & mask;
+  size_t first = size < mask + 1 - start ? size : mask + 1 - start;
+  memcpy(base + start, input, first);
+  memcpy(base, (const char *)input + first, size - first);
+}
+
+static void load_from_x(void *output, struct amx_state *state, size_t offset,
+                        size_t size) {
+  amx_sim_copy_from(output, (char *)&state->x, 0x1FF, offset, size);
+}
+
+static void load_from_y(void *output, struct amx_state *state, size_t offset,
+                        size_t size) {
+  amx_sim_copy_from(output, (char *)&state->y, 0x1FF, offset, size);
+}
+
+static void load_from_z(void *output, struct amx_state *state, size_t offset,
+                        size_t size) {
+  amx_sim_copy_from(output, (char *)&state->z, 0xFFF, offset, size);
+}
+
+static void store_to_x(void *output, struct amx_state *state, size_t offset,
+                       size_t size) {
+  amx_sim_copy_to((char *)&state->x, output, 0x1FF, offset, size);
+}
+
+static void store_to_y(void *output, struct amx_state *state, size_t offset,
+                       size_t size) {
+  amx_sim_copy_to((char *)&state->y, output, 0x1FF, offset, size);
+}
+
+// outer products of the fma instructions, one z row at a time:
+//   z[j * stride][i] = x[i] * y[j] + (skip_z ? 0 : z[j * stride][i])
+// with one rounding, so they give the same bits as fma32/fma64
+
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+
+static void amx_sim_outer_f32(union amx_row *z, int stride, const float *x,
+                              const float *y, int rows, bool skip_z) {
+  float32x4_t xv[4];
+  for (int i = 0; i < 4; i++) {
+    xv[i] = vld1q_f32(x + i * 4);
+  }
+  for (int j = 0; j < rows; j++) {
+    float *row = z[j * stride].f32;
+    float32x4_t yv = vdupq_n_f32(y[j]);
+    for (int i = 0; i < 4; i++) {
+      float32x4_t acc = skip_z ? vdupq_n_f32(0) : vld1q_f32(row + i * 4);
+      vst1q_f32(row + i * 4, vfmaq_f32(acc, xv[i], yv));
+    }
+  }
+}
+
+static void amx_sim_outer_f64(union amx_row *z, int stride, const double *x,
+                              const double *y, int rows, bool skip_z) {
+  float64x2_t xv[4];
+  for (int i = 0; i < 4; i++) {
+    xv[i] = vld1q_f64(x + i * 2);
+  }
+  for (int j = 0; j < rows; j++) {
+    double *row = z[j * stride].f64;
+    float64x2_t yv = vdupq_n_f64(y[j]);
+    for (int i = 0; i < 4; i++) {
+      float64x2_t acc = skip_z ? vdupq_n_f64(0) : vld1q_f64(row + i * 2);
+      vst1q_f64(row + i * 2, vfmaq_f64(acc, xv[i], yv));
+    }
+  }
+}
+
+#else
+
+static void amx_sim_outer_f32_scalar(union amx_row *z, int stride,
+                                     const float *x, const float *y, int rows,
+                                     bool skip_z) {
+  for (int j = 0; j < rows; j++) {
+    float *row = z[j * stride].f32;
+    for (int i = 0; i < 16; i++) {
+      row[i] = fma32(x[i], y[j], skip_z ? 0.0f : row[i]);
+    }
+  }
+}
+
+static void amx_sim_outer_f64_scalar(union amx_row *z, int stride,
+                                     const double *x, const double *y, int rows,
+                                     bool skip_z) {
+  for (int j = 0; j < rows; j++) {
+    double *row = z[j * stride].f64;
+    for (int i = 0; i < 8; i++) {
+      row[i] = fma64(x[i], y[j], skip_z ? 0.0 : row[i]);
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// avx2 and fma are checked at runtime, so no -mavx2 -mfma is needed. threads
+// racing on the first check all store the same answer, atomically
+static bool amx_sim_has_avx2_fma(void) {
+  static int has = -1;
+  int value = __atomic_load_n(&has, __ATOMIC_RELAXED);
+  if (value < 0) {
+    __builtin_cpu_init();
+    value = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    __atomic_store_n(&has, value, __ATOMIC_RELAXED);
+  }
+  return value;
+}
+
+__attribute__((target("avx2,fma"))) static void
+amx_sim_outer_f32_avx2(union amx_row *z, int stride, const float *x,
+                       const float *y, int rows, bool skip_z) {
+  __m256 x0 = _mm256_loadu_ps(x);
+  __m256 x1 = _mm256_loadu_ps(x + 8);
+  for (int j = 0; j < rows; j++) {
+    float *row = z[j * stride].f32;
+    __m256 yv = _mm256_set1_ps(y[j]);
+    __m256 z0 = skip_z ? _mm256_setzero_ps() : _mm256_loadu_ps(row);
+    __m256 z1 = skip_z ? _mm256_setzero_ps() : _mm256_loadu_ps(row + 8);
+    _mm256_storeu_ps(row, _mm256_fmadd_ps(x0, yv, z0));
+    _mm256_storeu_ps(row + 8, _mm256_fmadd_ps(x1, yv, z1));
+  }
+}
+
+__attribute__((target("avx2,fma"))) static void
+amx_sim_outer_f64_avx2(union amx_row *z, int stride, const double *x,
+                       const double *y, int rows, bool skip_z) {
+  __m256d x0 = _mm256_loadu_pd(x);
+  __m256d x1 = _mm256_loadu_pd(x + 4);
+  for (int j = 0; j < rows; j++) {
+    double *row = z[j * stride].f64;
+    __m256d yv = _mm256_set1_pd(y[j]);
+    __m256d z0 = skip_z ? _mm256_setzero_pd() : _mm256_loadu_pd(row);
+    __m256d z1 = skip_z ? _mm256_setzero_pd() : _mm256_loadu_pd(row + 4);
+    _mm256_storeu_pd(row, _mm256_fmadd_pd(x0, yv, z0));
+    _mm256_storeu_pd(row + 4, _mm256_fmadd_pd(x1, yv, z1));
+  }
+}
+
+#endif
+
+static void amx_sim_outer_f32(union amx_row *z, int stride, const float *x,
+                              const float *y, int rows, bool skip_z) {
+#if defined(__x86_64__) || defined(__i386__)
+  if (amx_sim_has_avx2_fma()) {
+    amx_sim_outer_f32_avx2(z, stride, x, y, rows, skip_z);
+    return;
+  }
+#endif
+  amx_sim_outer_f32_scalar(z, stride, x, y, rows, skip_z);
+}
+
+static void amx_sim_outer_f64(union amx_row *z, int stride, const double *x,
+                              const double *y, int rows, bool skip_z) {
+#if defined(__x86_64__) || defined(__i386__)
+  if (amx_sim_has_avx2_fma()) {
+    amx_sim_outer_f64_avx2(z, stride, x, y, rows, skip_z);
+    return;
+  }
+#endif
+  amx_sim_outer_f64_scalar(z, stride, x, y, rows, skip_z);
+}
+
+#endif
+
+#endif
+
 #define FMA_SKIP_Z_INPUT (1ull << 27)
 #define FMA_SKIP_Y_INPUT (1ull << 28)
 #define FMA_SKIP_X_INPUT (1ull << 29)
+#define FMA_ROW_DISABLE(operand) (((operand) >> 32) & 0x7F)
+#define FMA_COL_DISABLE(operand) (((operand) >> 41) & 0x7F)
+#define FMA_DISABLE_FIELDS ((0x7Full << 32) | (0x7Full << 41))
+
+// row disable (y entries, bits 32-38) and column disable (x entries, bits
+// 41-47) of the fma and mac ops, as described in aarch64_amx.py:
+//   0: all entries, 1: odd entries, 2: even entries,
+//   0x20 | n: entry n, 0x40 | n: the first n, 0x60 | n: the last n
+// other values are not known and process all entries. disabled entries of z
+// are not changed, even with FMA_SKIP_Z_INPUT. in vector mode a lane is
+// processed if both its row and its column are enabled (a guess).
+static void amx_fma_enabled(bool *enabled, uint64_t disable, int count) {
+  uint64_t n = disable & 0x1F;
+  for (int i = 0; i < count; i++) {
+    switch (disable & 0x60) {
+    case 0x20:
+      enabled[i] = (uint64_t)i == n;
+      break;
+    case 0x40:
+      enabled[i] = (uint64_t)i < n;
+      break;
+    case 0x60:
+      enabled[i] = (uint64_t)i + n >= (uint64_t)count;
+      break;
+    default:
+      enabled[i] = disable == 1 ? (i & 1) : disable == 2 ? !(i & 1) : true;
+      break;
+    }
+  }
+}
 
 static void amx_state_fmas32_impl(struct amx_state *state, uint64_t operand,
                                   bool sub) {
@@ -225,17 +457,36 @@ static void amx_state_fmas32_impl(struct amx_state *state, uint64_t operand,
   }
 
   float sub_mul = sub ? -1.0 : 1.0;
+  bool rows[16], cols[16];
+  amx_fma_enabled(rows, FMA_ROW_DISABLE(operand), 16);
+  amx_fma_enabled(cols, FMA_COL_DISABLE(operand), 16);
 
   if (operand & (1ull << 63)) {
     for (int i = 0; i < 16; i++) {
+      if (!rows[i] || !cols[i]) {
+        continue;
+      }
       float *z = &state->z[z_offset].f32[i];
       *z =
           fma32(sub_mul * x[i], y[i], (operand & FMA_SKIP_Z_INPUT) ? 0.0f : *z);
     }
   } else {
     z_offset &= 3;
+#ifndef AMX_SIM_SCALAR
+    if (!(operand & FMA_DISABLE_FIELDS)) {
+      for (int i = 0; i < 16; i++) {
+        x[i] = sub_mul * x[i];
+      }
+      amx_sim_outer_f32(&state->z[z_offset], 4, x, y, 16,
+                        operand & FMA_SKIP_Z_INPUT);
+      return;
+    }
+#endif
     for (int i = 0; i < 16; i++) {
       for (int j = 0; j < 16; j++) {
+        if (!rows[j] || !cols[i]) {
+          continue;
+        }
         float *z = &state->z[(j * 4) + z_offset].f32[i];
         *z = fma32(sub_mul * x[i], y[j],
                    (operand & FMA_SKIP_Z_INPUT) ? 0.0f : *z);
@@ -285,17 +536,36 @@ static void amx_state_fmas64_impl(struct amx_state *state, uint64_t operand,
   }
 
   double sub_mul = sub ? -1.0 : 1.0;
+  bool rows[8], cols[8];
+  amx_fma_enabled(rows, FMA_ROW_DISABLE(operand), 8);
+  amx_fma_enabled(cols, FMA_COL_DISABLE(operand), 8);
 
   if (operand & (1ull << 63)) {
     for (int i = 0; i < 8; i++) {
+      if (!rows[i] || !cols[i]) {
+        continue;
+      }
       double *z = &state->z[z_offset].f64[i];
       *z =
           fma64(sub_mul * x[i], y[i], (operand & FMA_SKIP_Z_INPUT) ? 0.0f : *z);
     }
   } else {
     z_offset &= 7;
+#ifndef AMX_SIM_SCALAR
+    if (!(operand & FMA_DISABLE_FIELDS)) {
+      for (int i = 0; i < 8; i++) {
+        x[i] = sub_mul * x[i];
+      }
+      amx_sim_outer_f64(&state->z[z_offset], 8, x, y, 8,
+                        operand & FMA_SKIP_Z_INPUT);
+      return;
+    }
+#endif
     for (int i = 0; i < 8; i++) {
       for (int j = 0; j < 8; j++) {
+        if (!rows[j] || !cols[i]) {
+          continue;
+        }
         double *z = &state->z[(j * 8) + z_offset].f64[i];
         *z = fma64(sub_mul * x[i], y[j],
                    (operand & FMA_SKIP_Z_INPUT) ? 0.0f : *z);
@@ -345,17 +615,44 @@ static void amx_state_fmas16_impl(struct amx_state *state, uint64_t operand,
   }
 
   float16 sub_mul = sub ? -1.0 : 1.0;
+  bool rows[32], cols[32];
+  amx_fma_enabled(rows, FMA_ROW_DISABLE(operand), 32);
+  amx_fma_enabled(cols, FMA_COL_DISABLE(operand), 32);
 
   if (operand & (1ull << 63)) {
     for (int i = 0; i < 32; i++) {
+      if (!rows[i] || !cols[i]) {
+        continue;
+      }
       float16 *z = &state->z[z_offset].f16[i];
       *z = fma16(sub_mul * x[i], y[i],
                  (operand & FMA_SKIP_Z_INPUT) ? (float16)0.0f : *z);
     }
   } else {
     z_offset &= 1;
+#ifndef AMX_SIM_SCALAR
+    // f16 * f16 + f32: even x lanes go to even z rows and odd ones to odd rows
+    if ((operand & (1ull << 62)) && !(operand & FMA_DISABLE_FIELDS)) {
+      float even[16], odd[16], yf[32];
+      for (int i = 0; i < 16; i++) {
+        even[i] = (float)sub_mul * (float)x[i * 2];
+        odd[i] = (float)sub_mul * (float)x[i * 2 + 1];
+      }
+      for (int j = 0; j < 32; j++) {
+        yf[j] = (float)y[j];
+      }
+      amx_sim_outer_f32(&state->z[0], 2, even, yf, 32,
+                        operand & FMA_SKIP_Z_INPUT);
+      amx_sim_outer_f32(&state->z[1], 2, odd, yf, 32,
+                        operand & FMA_SKIP_Z_INPUT);
+      return;
+    }
+#endif
     for (int i = 0; i < 32; i++) {
       for (int j = 0; j < 32; j++) {
+        if (!rows[j] || !cols[i]) {
+          continue;
+        }
         if (operand & (1ull << 62)) {
           float *z = &state->z[(j * 2) + (i & 1)].f32[i >> 1];
           float acc = (operand & FMA_SKIP_Z_INPUT) ? 0 : *z;
@@ -410,8 +707,15 @@ void amx_state_mac16(struct amx_state *state, uint64_t operand) {
     }
   }
 
+  bool rows[32], cols[32];
+  amx_fma_enabled(rows, FMA_ROW_DISABLE(operand), 32);
+  amx_fma_enabled(cols, FMA_COL_DISABLE(operand), 32);
+
   if (operand & (1ull << 63)) {
     for (int i = 0; i < 32; i++) {
+      if (!rows[i] || !cols[i]) {
+        continue;
+      }
       uint16_t *z = &state->z[z_offset].u16[i];
       *z = mac16(x[i], y[i], (operand & FMA_SKIP_Z_INPUT) ? (uint16_t)0 : *z);
     }
@@ -419,6 +723,9 @@ void amx_state_mac16(struct amx_state *state, uint64_t operand) {
     z_offset &= 1;
     for (int i = 0; i < 32; i++) {
       for (int j = 0; j < 32; j++) {
+        if (!rows[j] || !cols[i]) {
+          continue;
+        }
         if (operand & (1ull << 62)) {
           uint32_t *z = &state->z[(j * 2) + (i & 1)].u32[i >> 1];
           uint32_t acc = (operand & FMA_SKIP_Z_INPUT) ? 0 : *z;
@@ -583,6 +890,273 @@ void amx_state_extry(struct amx_state *state, uint64_t operand) {
   }
 }
 
+// not simulated yet, stop instead of giving wrong results
+static void amx_state_unimplemented(const char *name, uint64_t operand) {
+  fprintf(stderr, "amx simulator: %s (operand 0x%016llx) is not implemented\n",
+          name, (unsigned long long)operand);
+  abort();
+}
+
+// ops 18 to 22. aarch64_amx.py only has guesses for these, so the simulator
+// implements those guesses with the operand layout of mac16/fma16, checked by
+// hwtest.c, and aborts on the operand bits it does not know:
+//
+//   vecint: z[z_offset].u16[i] += x.u16[i] + y.u16[i], for the 32 lanes
+//   vecfp:  the same in fp16, x + y rounded, then added to z and rounded
+//     y offset: operand & 0x1FF, x offset: (operand >> 10) & 0x1FF
+//     z row: (operand >> 20) & 63
+//     bit 27 skips z, bits 28 and 29 skip y and x (0 instead)
+//     a lane is disabled by the row or the column disable field, as in the
+//     vector form of the fma ops
+//   matint, matfp: the matrix form of mac16 and fma16 ("doesn't fma16 do
+//     this?"), bit 63 aborts as vecint and vecfp are the vector forms
+//   genlut: with operand 0 (xzr), the 16 signed 32-bit lanes of x[0] are both
+//     the values and a sorted table. lane i of the 64-bit result in
+//     x[0].u64[0] is the index of the last entry of the table before the
+//     first one greater than value i, 0xF if there is none.
+
+#define VEC_KNOWN_FIELDS                                                       \
+  (0x1FFull | (0x1FFull << 10) | (63ull << 20) | FMA_SKIP_Z_INPUT |            \
+   FMA_SKIP_Y_INPUT | FMA_SKIP_X_INPUT | FMA_DISABLE_FIELDS)
+
+static void amx_state_vec_inputs(struct amx_state *state, uint64_t operand,
+                                 void *x, void *y, bool *lanes) {
+  if (operand & FMA_SKIP_X_INPUT) {
+    memset(x, 0, 0x40);
+  } else {
+    load_from_x(x, state, (operand >> 10) & 0x1FF, 0x40);
+  }
+  if (operand & FMA_SKIP_Y_INPUT) {
+    memset(y, 0, 0x40);
+  } else {
+    load_from_y(y, state, operand & 0x1FF, 0x40);
+  }
+  bool rows[32], cols[32];
+  amx_fma_enabled(rows, FMA_ROW_DISABLE(operand), 32);
+  amx_fma_enabled(cols, FMA_COL_DISABLE(operand), 32);
+  for (int i = 0; i < 32; i++) {
+    lanes[i] = rows[i] && cols[i];
+  }
+}
+
+void amx_state_vecint(struct amx_state *state, uint64_t operand) {
+  if (operand & ~VEC_KNOWN_FIELDS) {
+    amx_state_unimplemented("vecint", operand);
+  }
+  uint16_t x[32], y[32];
+  bool lanes[32];
+  amx_state_vec_inputs(state, operand, x, y, lanes);
+  union amx_row *z = &state->z[(operand >> 20) & 63];
+  for (int i = 0; i < 32; i++) {
+    if (lanes[i]) {
+      uint16_t acc = (operand & FMA_SKIP_Z_INPUT) ? 0 : z->u16[i];
+      z->u16[i] = (uint16_t)(acc + x[i] + y[i]);
+    }
+  }
+}
+
+void amx_state_vecfp(struct amx_state *state, uint64_t operand) {
+  if (operand & ~VEC_KNOWN_FIELDS) {
+    amx_state_unimplemented("vecfp", operand);
+  }
+  float16 x[32], y[32];
+  bool lanes[32];
+  amx_state_vec_inputs(state, operand, x, y, lanes);
+  union amx_row *z = &state->z[(operand >> 20) & 63];
+  for (int i = 0; i < 32; i++) {
+    if (lanes[i]) {
+      // sums of two fp16 are exact in double, so each step rounds once
+      float16 sum = (float16)((double)x[i] + (double)y[i]);
+      if (operand & FMA_SKIP_Z_INPUT) {
+        z->f16[i] = sum;
+      } else {
+        z->f16[i] = (float16)((double)z->f16[i] + (double)sum);
+      }
+    }
+  }
+}
+
+void amx_state_matint(struct amx_state *state, uint64_t operand) {
+  if (operand & (1ull << 63)) {
+    amx_state_unimplemented("matint", operand);
+  }
+  amx_state_mac16(state, operand);
+}
+
+void amx_state_matfp(struct amx_state *state, uint64_t operand) {
+  if (operand & (1ull << 63)) {
+    amx_state_unimplemented("matfp", operand);
+  }
+  amx_state_fma16(state, operand);
+}
+
+void amx_state_genlut(struct amx_state *state, uint64_t operand) {
+  if (operand != 0) {
+    amx_state_unimplemented("genlut", operand);
+  }
+  int32_t *table = (int32_t *)state->x[0].u32;
+  uint64_t result = 0;
+  for (int i = 0; i < 16; i++) {
+    int index = 0;
+    while (index < 16 && table[index] <= table[i]) {
+      index++;
+    }
+    result |= (uint64_t)((index - 1) & 0xF) << (i * 4);
+  }
+  state->x[0].u64[0] = result;
+}
+
+// run one instruction, start and stop do not change the state
+void amx_state_execute(struct amx_state *state, int op, uint64_t operand) {
+  switch (op) {
+  case AMX_OP_LDX: amx_state_ldx(state, operand); break;
+  case AMX_OP_LDY: amx_state_ldy(state, operand); break;
+  case AMX_OP_STX: amx_state_stx(state, operand); break;
+  case AMX_OP_STY: amx_state_sty(state, operand); break;
+  case AMX_OP_LDZ: amx_state_ldz(state, operand); break;
+  case AMX_OP_STZ: amx_state_stz(state, operand); break;
+  case AMX_OP_LDZI: amx_state_ldzi(state, operand); break;
+  case AMX_OP_STZI: amx_state_stzi(state, operand); break;
+  case AMX_OP_EXTRX: amx_state_extrx(state, operand); break;
+  case AMX_OP_EXTRY: amx_state_extry(state, operand); break;
+  case AMX_OP_FMA64: amx_state_fma64(state, operand); break;
+  case AMX_OP_FMS64: amx_state_fms64(state, operand); break;
+  case AMX_OP_FMA32: amx_state_fma32(state, operand); break;
+  case AMX_OP_FMS32: amx_state_fms32(state, operand); break;
+  case AMX_OP_MAC16: amx_state_mac16(state, operand); break;
+  case AMX_OP_FMA16: amx_state_fma16(state, operand); break;
+  case AMX_OP_FMS16: amx_state_fms16(state, operand); break;
+  case AMX_OP_START_STOP: break;
+  case AMX_OP_VECINT: amx_state_vecint(state, operand); break;
+  case AMX_OP_VECFP: amx_state_vecfp(state, operand); break;
+  case AMX_OP_MATINT: amx_state_matint(state, operand); break;
+  case AMX_OP_MATFP: amx_state_matfp(state, operand); break;
+  case AMX_OP_GENLUT: amx_state_genlut(state, operand); break;
+  default: amx_state_unimplemented("unknown opcode", operand); break;
+  }
+}
+
+#ifdef AMX_SIMULATOR
+
+// AMX_START creates the amx context of the calling thread and AMX_STOP
+// destroys it, so every thread has its own state and there is no state
+// outside AMX_START/AMX_STOP. as on hardware, an instruction without a context
+// is an error, and aborts. AMX_START with a context clears it.
+//
+// live contexts are kept in a registry (amx_sim_for_each_context), to check
+// and profile multithreaded drivers.
+
+struct amx_sim_context {
+  struct amx_state state;
+  pthread_t thread;
+  uint64_t instructions;
+  struct amx_sim_context *prev;
+  struct amx_sim_context *next;
+};
+
+struct amx_sim_stats {
+  uint64_t created;
+  uint64_t live;
+  uint64_t peak;         // most contexts live at once
+  uint64_t instructions; // of the destroyed contexts
+};
+
+static pthread_mutex_t amx_sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct amx_sim_context *amx_sim_contexts = NULL;
+static struct amx_sim_stats amx_sim_totals;
+static __thread struct amx_sim_context *amx_sim_context = NULL;
+
+static void amx_sim_create(void) {
+  struct amx_sim_context *context =
+      (struct amx_sim_context *)aligned_alloc(0x80, sizeof *context);
+  if (context == NULL) {
+    fprintf(stderr, "amx simulator: out of memory\n");
+    abort();
+  }
+  amx_state_zero(&context->state);
+  context->thread = pthread_self();
+  context->instructions = 0;
+  context->prev = NULL;
+  pthread_mutex_lock(&amx_sim_lock);
+  context->next = amx_sim_contexts;
+  if (amx_sim_contexts) {
+    amx_sim_contexts->prev = context;
+  }
+  amx_sim_contexts = context;
+  amx_sim_totals.created++;
+  if (++amx_sim_totals.live > amx_sim_totals.peak) {
+    amx_sim_totals.peak = amx_sim_totals.live;
+  }
+  pthread_mutex_unlock(&amx_sim_lock);
+  amx_sim_context = context;
+}
+
+static void amx_sim_destroy(void) {
+  struct amx_sim_context *context = amx_sim_context;
+  pthread_mutex_lock(&amx_sim_lock);
+  if (context->prev) {
+    context->prev->next = context->next;
+  } else {
+    amx_sim_contexts = context->next;
+  }
+  if (context->next) {
+    context->next->prev = context->prev;
+  }
+  amx_sim_totals.live--;
+  amx_sim_totals.instructions += context->instructions;
+  pthread_mutex_unlock(&amx_sim_lock);
+  free(context);
+  amx_sim_context = NULL;
+}
+
+void amx_sim_execute(int op, uint64_t operand) {
+  if (op == AMX_OP_START_STOP) {
+    if (operand == 0) {
+      if (amx_sim_context) {
+        amx_state_zero(&amx_sim_context->state);
+      } else {
+        amx_sim_create();
+      }
+    } else if (amx_sim_context) {
+      amx_sim_destroy();
+    }
+  } else {
+    if (amx_sim_context == NULL) {
+      fprintf(stderr, "amx simulator: instruction %d outside AMX_START/AMX_STOP\n",
+              op);
+      abort();
+    }
+    amx_state_execute(&amx_sim_context->state, op, operand);
+    amx_sim_context->instructions++;
+  }
+  amx_run_hooks(op, operand);
+}
+
+// the state of the calling thread, NULL outside AMX_START/AMX_STOP
+struct amx_state *amx_sim_current_state(void) {
+  return amx_sim_context ? &amx_sim_context->state : NULL;
+}
+
+struct amx_sim_stats amx_sim_get_stats(void) {
+  pthread_mutex_lock(&amx_sim_lock);
+  struct amx_sim_stats stats = amx_sim_totals;
+  pthread_mutex_unlock(&amx_sim_lock);
+  return stats;
+}
+
+// fn sees every live context, with the registry locked: fn must not use amx
+void amx_sim_for_each_context(void (*fn)(void *arg,
+                                         const struct amx_sim_context *context),
+                              void *arg) {
+  pthread_mutex_lock(&amx_sim_lock);
+  for (struct amx_sim_context *c = amx_sim_contexts; c; c = c->next) {
+    fn(arg, c);
+  }
+  pthread_mutex_unlock(&amx_sim_lock);
+}
+
+#endif
+
 // print flags
 enum print_flags {
   PF_TYPE_MASK = 0x0F,
@@ -719,3 +1293,8 @@ int diff_amx_state(struct amx_state *a, struct amx_state *b, int flags) {
   }
   return same;
 }
+
+#ifdef AMX_SIMULATOR
+#include "amx_timing.h"
+#include "amx_trace.h"
+#endif
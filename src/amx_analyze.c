@@ -0,0 +1,96 @@
+/*
+ *  amx_analyze: dependency analysis of amx instruction streams
+ *  (dougallj/amx_analysis.h): critical path, fma/load ratio,
+ *  z reuse distance and stalls from too few accumulators
+ *
+ *  usage: ./amx_analyze trace...             traces of dougallj/amx_trace.h
+ *         ./amx_analyze -k kernel M N K      run an sgemm kernel (1, 2, 3)
+ */
+
+// compile options: -O3 -DAMX_SIMULATOR -o amx_analyze -lm
+
+#include <stdio.h>
+#include <string.h>
+
+#include "amx_sgemm.h"
+#include "../dougallj/amx_analysis.h"
+
+#ifndef AMX_SIMULATOR
+#error "amx_analyze needs -DAMX_SIMULATOR"
+#endif
+
+static void analysis_hook(void *context, int op, uint64_t operand)
+{
+    amx_analysis_issue((struct amx_analysis *)context, op, operand);
+}
+
+static int analyze_trace(const char *path)
+{
+    struct amx_trace_reader reader;
+    struct amx_trace_record record;
+    struct amx_analysis analysis;
+    const uint8_t *memory;
+    int result;
+    if (amx_trace_map(&reader, path))
+    {
+        printf("Error: %s is not an amx trace\n", path);
+        return -1;
+    }
+    amx_analysis_init(&analysis, NULL);
+    while ((result = amx_trace_next(&reader, &record, &memory)) == 1)
+        amx_analysis_issue(&analysis, record.op, record.operand);
+    printf("%s:\n", path);
+    amx_analysis_print(&analysis, stdout);
+    if (result)
+        printf("Error: %s is truncated\n", path);
+    amx_trace_unmap(&reader);
+    return result;
+}
+
+static int analyze_kernel(enum AMX_SGEMM_KERNEL kernel, uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    if (!amx_sgemm_kernel_supported(kernel, sizei, sizej, sizek))
+    {
+        printf("Error: kernel %d does not support %llu %llu %llu\n", (int)kernel,
+               (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek);
+        return -1;
+    }
+    float *A = (float *)aligned_alloc(128, sizei * sizek * sizeof(float));
+    float *B = (float *)aligned_alloc(128, sizek * sizej * sizeof(float));
+    float *C = (float *)aligned_alloc(128, sizei * sizej * sizeof(float));
+    for (uint64_t i = 0; i < sizei * sizek; i++)
+        A[i] = (rand() % 20 + 1) / 100.0;
+    for (uint64_t i = 0; i < sizek * sizej; i++)
+        B[i] = (rand() % 20 + 1) / 100.0;
+
+    struct amx_analysis analysis;
+    amx_analysis_init(&analysis, NULL);
+    amx_add_hook(analysis_hook, &analysis);
+    amx_sgemm_run(kernel, A, B, C, sizei, sizej, sizek);
+    amx_remove_hook(analysis_hook, &analysis);
+    printf("kernel %d, %llu %llu %llu:\n", (int)kernel,
+           (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek);
+    amx_analysis_print(&analysis, stdout);
+
+    free(A);
+    free(B);
+    free(C);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 6 && strcmp(argv[1], "-k") == 0)
+        return analyze_kernel((enum AMX_SGEMM_KERNEL)atoi(argv[2]), strtoull(argv[3], NULL, 10),
+                              strtoull(argv[4], NULL, 10), strtoull(argv[5], NULL, 10));
+    if (argc < 2 || strcmp(argv[1], "-k") == 0)
+    {
+        printf("usage: %s trace...\n", argv[0]);
+        printf("       %s -k kernel M N K\n", argv[0]);
+        return -1;
+    }
+    int result = 0;
+    for (int arg = 1; arg < argc; arg++)
+        result |= analyze_trace(argv[arg]);
+    return result;
+}
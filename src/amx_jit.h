@@ -0,0 +1,242 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the amx instructions only run on apple silicon, and not in simulator builds
+#if defined(__APPLE__) && defined(__aarch64__) && !defined(AMX_SIMULATOR)
+#define AMX_JIT_NATIVE 1
+#include <libkern/OSCacheControl.h>
+#include <sys/mman.h>
+#endif
+
+#include "amx_sgemm.1.h"
+
+/*
+ *  jit of the amx_sgemm.1.h tile: C[i:i+16][j:j+32] = A[i:i+16][:] * B[:][j:j+32]
+ *
+ *  the k loop is fully unrolled and the strides are folded into immediates, so
+ *  between two amx instructions there are only the movz/movk/add/orr building
+ *  the operand, no loop counter, branch or multiply.
+ *
+ *  generated code is void tile(const float *A, const float *B, float *C):
+ *      x0, x1, x2: A[i][0], B[0][j], C[i][j]
+ *      x9: amx operand, x10: scratch
+ *
+ *  code is emitted on every host, it can be run by amx_jit_simulate (amx_jit_sim.h);
+ *  it is mapped executable on apple silicon hardware builds only, elsewhere (and
+ *  with -DAMX_SIMULATOR, whose hooks, traces and timing it would bypass)
+ *  amx_jit_sgemm uses _amx_sgemm_1
+ */
+
+#define AMX_JIT_MAX_WORDS (1ull << 18) // 1 MB of code per tile
+#define AMX_JIT_CACHE_SIZE 64
+
+// aarch64 encodings used by the jit
+#define A64_NOP 0xD503201Fu
+#define A64_RET 0xD65F03C0u
+#define A64_MOVZ(rd, imm16, hw) (0xD2800000u | ((uint32_t)(hw) << 21) | ((uint32_t)(imm16) << 5) | (uint32_t)(rd))
+#define A64_MOVK(rd, imm16, hw) (0xF2800000u | ((uint32_t)(hw) << 21) | ((uint32_t)(imm16) << 5) | (uint32_t)(rd))
+#define A64_ADD_IMM(rd, rn, imm12) (0x91000000u | ((uint32_t)(imm12) << 10) | ((uint32_t)(rn) << 5) | (uint32_t)(rd))
+#define A64_ADD(rd, rn, rm) (0x8B000000u | ((uint32_t)(rm) << 16) | ((uint32_t)(rn) << 5) | (uint32_t)(rd))
+#define A64_ORR(rd, rn, rm) (0xAA000000u | ((uint32_t)(rm) << 16) | ((uint32_t)(rn) << 5) | (uint32_t)(rd))
+#define A64_AMX(op, rn) (0x00201000u | ((uint32_t)(op) << 5) | (uint32_t)(rn))
+
+#define AMX_JIT_REG_A 0
+#define AMX_JIT_REG_B 1
+#define AMX_JIT_REG_C 2
+#define AMX_JIT_REG_OPERAND 9
+#define AMX_JIT_REG_SCRATCH 10
+
+struct amx_jit_code
+{
+    uint32_t *words;
+    uint64_t size;
+    uint64_t capacity;
+};
+
+typedef void (*amx_jit_tile_fn)(const float *A, const float *B, float *C);
+
+struct amx_jit_entry
+{
+    uint64_t sizek;
+    uint64_t lda;
+    uint64_t ldb;
+    uint64_t ldc;
+    amx_jit_tile_fn tile;
+};
+
+static struct amx_jit_entry amx_jit_cache[AMX_JIT_CACHE_SIZE];
+static uint64_t amx_jit_cache_size = 0;
+static pthread_mutex_t amx_jit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void amx_jit_word(struct amx_jit_code *code, uint32_t word)
+{
+    if (code->size == code->capacity)
+    {
+        code->capacity = code->capacity ? code->capacity * 2 : 1024;
+        code->words = (uint32_t *)realloc(code->words, code->capacity * sizeof(uint32_t));
+    }
+    code->words[code->size++] = word;
+}
+
+/* movz + movk of the non zero 16 bits chunks */
+void amx_jit_mov64(struct amx_jit_code *code, uint64_t rd, uint64_t value)
+{
+    int first = 1;
+    for (uint64_t hw = 0; hw < 4; hw++)
+    {
+        uint64_t chunk = (value >> (hw << 4)) & 0xFFFFull;
+        if (chunk == 0 && !(first && hw == 3))
+            continue;
+        amx_jit_word(code, first ? A64_MOVZ(rd, chunk, hw) : A64_MOVK(rd, chunk, hw));
+        first = 0;
+    }
+}
+
+/* amx op with an operand that has no address */
+void amx_jit_op(struct amx_jit_code *code, uint64_t op, uint64_t operand)
+{
+    amx_jit_mov64(code, AMX_JIT_REG_OPERAND, operand);
+    amx_jit_word(code, A64_AMX(op, AMX_JIT_REG_OPERAND));
+}
+
+/* amx load/store of base + offset bytes, flags are bits 56~62 (register offset and mode) */
+void amx_jit_ldst(struct amx_jit_code *code, uint64_t op, uint64_t base, uint64_t offset, uint64_t flags)
+{
+    if (offset < (1ull << 12))
+    {
+        amx_jit_word(code, A64_ADD_IMM(AMX_JIT_REG_OPERAND, base, offset));
+    }
+    else
+    {
+        amx_jit_mov64(code, AMX_JIT_REG_SCRATCH, offset);
+        amx_jit_word(code, A64_ADD(AMX_JIT_REG_OPERAND, base, AMX_JIT_REG_SCRATCH));
+    }
+    if (flags)
+    {
+        amx_jit_word(code, A64_MOVZ(AMX_JIT_REG_SCRATCH, flags >> 48, 3));
+        amx_jit_word(code, A64_ORR(AMX_JIT_REG_OPERAND, AMX_JIT_REG_OPERAND, AMX_JIT_REG_SCRATCH));
+    }
+    amx_jit_word(code, A64_AMX(op, AMX_JIT_REG_OPERAND));
+}
+
+/*
+ *  emit the tile function, same instructions as the k loop of _amx_sgemm_1
+ *  lda, ldb, ldc: row strides of A, B and C in floats
+ */
+void amx_jit_emit_tile(struct amx_jit_code *code, uint64_t sizek, uint64_t lda, uint64_t ldb, uint64_t ldc)
+{
+    for (uint64_t k = 0ull; k < sizek; k += 16ull)
+    {
+        // load A[i:i+16][k:k+16], see load_A_to_Z
+        for (uint64_t offset = 0ull; offset < 16ull; offset++)
+            amx_jit_ldst(code, AMX_OP_LDZ, AMX_JIT_REG_A, (lda * offset + k) * sizeof(float), ((offset << 2) + 2ull) << 56);
+        for (uint64_t l = 0ull; l < 4; l++)
+        {
+            // load B[k+l*4:k+l*4+4][j:j+2*16], see load_B_to_X
+            for (uint64_t i = 0; i < 4; i++)
+                amx_jit_ldst(code, AMX_OP_LDX, AMX_JIT_REG_B, ldb * (k + (l << 2) + i) * sizeof(float), (1ull << 62) | ((i << 1) << 56));
+            // see transpose_Z_to_Y
+            if (l % 2 == 0)
+            {
+                uint64_t oprand = 0x8000000010004000 | ((2ull + (l >> 1 << 3 << 2)) << 20);
+                for (uint64_t i = 0; i < 8ull; i++)
+                {
+                    amx_jit_op(code, AMX_OP_EXTRY, oprand);
+                    oprand += ((1ull << 2) << 20);
+                    oprand += (1ull << 6);
+                }
+            }
+            for (uint64_t m = 0; m < 4; m++)
+            {
+                uint64_t xoffset = m << 1;
+                uint64_t yoffset = m + ((l & 1ull) << 2);
+                uint64_t zignore = k == 0ull && l == 0ull && m == 0ull ? 1ull : 0ull;
+                // see amx_fma32
+                amx_jit_op(code, AMX_OP_FMA32, (yoffset << 6) | (xoffset << 6 << 10) | (0ull << 20) | (zignore << 27));
+                xoffset += 1ull;
+                amx_jit_op(code, AMX_OP_FMA32, (yoffset << 6) | (xoffset << 6 << 10) | (1ull << 20) | (zignore << 27));
+            }
+        }
+    }
+    // see store_Z_to_C
+    for (uint64_t offset = 0; offset < 16ull; offset++)
+        amx_jit_ldst(code, AMX_OP_STZ, AMX_JIT_REG_C, ldc * offset * sizeof(float), (1ull << 62) | ((offset << 2) << 56));
+    amx_jit_word(code, A64_RET);
+}
+
+/* copy code to executable memory, NULL if the host can not run it */
+amx_jit_tile_fn amx_jit_map(const struct amx_jit_code *code)
+{
+#ifdef AMX_JIT_NATIVE
+    size_t bytes = code->size * sizeof(uint32_t);
+    void *memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANON | MAP_JIT, -1, 0);
+    if (memory == MAP_FAILED)
+        return NULL;
+    pthread_jit_write_protect_np(0);
+    memcpy(memory, code->words, bytes);
+    pthread_jit_write_protect_np(1);
+    sys_icache_invalidate(memory, bytes);
+    return (amx_jit_tile_fn)memory;
+#else
+    (void)code;
+    return NULL;
+#endif
+}
+
+/* cached tile function of a shape and strides, NULL if it can not be jitted here or the cache is full */
+amx_jit_tile_fn amx_jit_tile(uint64_t sizek, uint64_t lda, uint64_t ldb, uint64_t ldc)
+{
+    amx_jit_tile_fn tile = NULL;
+    pthread_mutex_lock(&amx_jit_lock);
+    for (uint64_t e = 0; e < amx_jit_cache_size; e++)
+    {
+        struct amx_jit_entry *entry = &amx_jit_cache[e];
+        if (entry->sizek == sizek && entry->lda == lda && entry->ldb == ldb && entry->ldc == ldc)
+        {
+            tile = entry->tile;
+            pthread_mutex_unlock(&amx_jit_lock);
+            return tile;
+        }
+    }
+    // a full cache keeps working, new shapes are not jitted: code is never
+    // unmapped, other threads may still run an entry that would be evicted
+    if (amx_jit_cache_size == AMX_JIT_CACHE_SIZE)
+    {
+        pthread_mutex_unlock(&amx_jit_lock);
+        return NULL;
+    }
+    struct amx_jit_code code = {NULL, 0, 0};
+    amx_jit_emit_tile(&code, sizek, lda, ldb, ldc);
+    if (code.size <= AMX_JIT_MAX_WORDS)
+        tile = amx_jit_map(&code);
+    free(code.words);
+    struct amx_jit_entry entry = {sizek, lda, ldb, ldc, tile};
+    amx_jit_cache[amx_jit_cache_size++] = entry;
+    pthread_mutex_unlock(&amx_jit_lock);
+    return tile;
+}
+
+/* same as _amx_sgemm_1, with the jitted tile when there is one */
+void amx_jit_sgemm(float *A, float *B, float *C, const uint64_t sizei, const uint64_t sizej, const uint64_t sizek)
+{
+    // limitation
+    if (sizei == 0ull || sizek == 0ull || sizej == 0ull)
+        return;
+    if (sizei % 32 != 0 || sizek % 32 != 0 || sizej % 32 != 0)
+        return;
+    amx_jit_tile_fn tile = amx_jit_tile(sizek, sizek, sizej, sizej);
+    if (tile == NULL)
+    {
+        _amx_sgemm_1(A, B, C, sizei, sizej, sizek);
+        return;
+    }
+    AMX_START();
+    for (uint64_t i = 0ull; i < sizei; i += 16ull)
+        for (uint64_t j = 0ull; j < sizej; j += 32ull)
+            tile(A + i * sizek, B + j, C + i * sizej + j);
+    AMX_STOP();
+}
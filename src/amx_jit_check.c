@@ -0,0 +1,132 @@
+/*
+ *  amx_jit_check: run the code emitted by amx_jit.h on the simulator and
+ *  compare it with _amx_sgemm_1, so the code generator is checked on any host
+ *
+ *  usage: ./amx_jit_check [M N K]...
+ *  without shapes, some square and skinny shapes
+ *  every shape runs amx_jit_sgemm_simulate (strides of the shape), then the
+ *  tiles alone with rows of A, B and C padded by 32 and 64 floats
+ *  returns 1 if a result differs by more than 1e-4 or the code does not run
+ */
+
+// compile options: -O3 -DAMX_SIMULATOR -o amx_jit_check -lm
+
+#include <math.h>
+#include <stdio.h>
+
+#include "amx_jit_sim.h"
+
+#ifndef AMX_SIMULATOR
+#error "amx_jit_check needs -DAMX_SIMULATOR"
+#endif
+
+static const uint64_t default_shapes[][3] = {
+    {32, 32, 32}, {64, 64, 96}, {128, 128, 128}, {32, 256, 64}, {256, 32, 64}, {64, 96, 256},
+};
+
+static const uint64_t pads[] = {32, 64};
+
+static float max_error(const float *C, uint64_t ldc, const float *ref, uint64_t sizei, uint64_t sizej)
+{
+    float error = 0.0f;
+    for (uint64_t i = 0; i < sizei; i++)
+        for (uint64_t j = 0; j < sizej; j++)
+            error = fmaxf(error, fabsf(C[i * ldc + j] - ref[i * sizej + j]));
+    return error;
+}
+
+/* the tiles of amx_jit_sgemm with row strides lda, ldb and ldc */
+static int run_strided(const float *A, const float *B, float *C, uint64_t sizei, uint64_t sizej, uint64_t sizek,
+                       uint64_t lda, uint64_t ldb, uint64_t ldc)
+{
+    struct amx_state state;
+    struct amx_jit_code code = {NULL, 0, 0};
+    int result = 0;
+    amx_state_zero(&state);
+    amx_jit_emit_tile(&code, sizek, lda, ldb, ldc);
+    for (uint64_t i = 0ull; i < sizei && result == 0; i += 16ull)
+        for (uint64_t j = 0ull; j < sizej && result == 0; j += 32ull)
+            result = amx_jit_simulate(&state, code.words, code.size,
+                                      (uint64_t)(A + i * lda), (uint64_t)(B + j), (uint64_t)(C + i * ldc + j));
+    free(code.words);
+    return result;
+}
+
+static int check_shape(uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    if (sizei % 32 != 0 || sizej % 32 != 0 || sizek % 32 != 0 || sizei == 0 || sizej == 0 || sizek == 0)
+    {
+        printf("skip %llu %llu %llu: sizes must be non zero multiples of 32\n",
+               (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek);
+        return 0;
+    }
+    float *A = (float *)aligned_alloc(128, sizei * sizek * sizeof(float));
+    float *B = (float *)aligned_alloc(128, sizek * sizej * sizeof(float));
+    float *C = (float *)aligned_alloc(128, sizei * sizej * sizeof(float));
+    float *ref = (float *)aligned_alloc(128, sizei * sizej * sizeof(float));
+    for (uint64_t i = 0; i < sizei * sizek; i++)
+        A[i] = (rand() % 20 + 1) / 100.0;
+    for (uint64_t i = 0; i < sizek * sizej; i++)
+        B[i] = (rand() % 20 + 1) / 100.0;
+    _amx_sgemm_1(A, B, ref, sizei, sizej, sizek);
+
+    int failed = 0;
+    int result = amx_jit_sgemm_simulate(A, B, C, sizei, sizej, sizek);
+    float error = max_error(C, sizej, ref, sizei, sizej);
+    failed |= result != 0 || !(error <= 1e-4f);
+    printf("%5llu %5llu %5llu  pad  0: %s, max error %g\n",
+           (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek,
+           result ? "unknown instruction" : "ok", error);
+
+    for (uint64_t p = 0; p < sizeof(pads) / sizeof(pads[0]); p++)
+    {
+        // padded copies, the pad of a row is garbage the tiles must not read
+        uint64_t lda = sizek + pads[p], ldb = sizej + pads[p], ldc = sizej + pads[p];
+        float *PA = (float *)aligned_alloc(128, sizei * lda * sizeof(float));
+        float *PB = (float *)aligned_alloc(128, sizek * ldb * sizeof(float));
+        float *PC = (float *)aligned_alloc(128, sizei * ldc * sizeof(float));
+        for (uint64_t i = 0; i < sizei * lda; i++)
+            PA[i] = NAN;
+        for (uint64_t i = 0; i < sizek * ldb; i++)
+            PB[i] = NAN;
+        for (uint64_t i = 0; i < sizei; i++)
+            memcpy(PA + i * lda, A + i * sizek, sizek * sizeof(float));
+        for (uint64_t k = 0; k < sizek; k++)
+            memcpy(PB + k * ldb, B + k * sizej, sizej * sizeof(float));
+        result = run_strided(PA, PB, PC, sizei, sizej, sizek, lda, ldb, ldc);
+        error = max_error(PC, ldc, ref, sizei, sizej);
+        failed |= result != 0 || !(error <= 1e-4f);
+        printf("%5llu %5llu %5llu  pad %2llu: %s, max error %g\n",
+               (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek,
+               (unsigned long long)pads[p], result ? "unknown instruction" : "ok", error);
+        free(PA);
+        free(PB);
+        free(PC);
+    }
+
+    free(A);
+    free(B);
+    free(C);
+    free(ref);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    if ((argc - 1) % 3 != 0)
+    {
+        printf("usage: %s [M N K]...\n", argv[0]);
+        return -1;
+    }
+    int failed = 0;
+    if (argc == 1)
+    {
+        for (uint64_t s = 0; s < sizeof(default_shapes) / sizeof(default_shapes[0]); s++)
+            failed |= check_shape(default_shapes[s][0], default_shapes[s][1], default_shapes[s][2]);
+    }
+    for (int arg = 1; arg + 2 < argc; arg += 3)
+        failed |= check_shape(strtoull(argv[arg], NULL, 10), strtoull(argv[arg + 1], NULL, 10),
+                              strtoull(argv[arg + 2], NULL, 10));
+    printf(failed ? "FAILED\n" : "passed\n");
+    return failed;
+}
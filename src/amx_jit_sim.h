@@ -0,0 +1,68 @@
+#pragma once
+
+#include "amx_jit.h"
+#include "../dougallj/simulator.h"
+
+/*
+ *  run jitted code on the simulator, to check amx_jit_emit_tile on any host
+ *  only the instructions emitted by amx_jit.h are decoded
+ *  return 0 at ret, -1 at an unknown instruction
+ */
+int amx_jit_simulate(struct amx_state *state, const uint32_t *words, uint64_t size,
+                     uint64_t x0, uint64_t x1, uint64_t x2)
+{
+    uint64_t x[32] = {0};
+    x[0] = x0;
+    x[1] = x1;
+    x[2] = x2;
+    for (uint64_t pc = 0; pc < size; pc++)
+    {
+        uint32_t word = words[pc];
+        uint64_t rd = word & 31u;
+        uint64_t rn = (word >> 5) & 31u;
+        uint64_t rm = (word >> 16) & 31u;
+        uint64_t shift = ((word >> 21) & 3u) << 4;
+        uint64_t imm16 = (word >> 5) & 0xFFFFu;
+        if ((word & 0xFFFFFC00u) == A64_AMX(0, 0))
+        {
+            if (rn >= AMX_OP_COUNT)
+                return -1;
+            amx_state_execute(state, (int)rn, rd == 31 ? 0ull : x[rd]);
+        }
+        else if ((word & 0xFF800000u) == A64_MOVZ(0, 0, 0))
+            x[rd] = imm16 << shift;
+        else if ((word & 0xFF800000u) == A64_MOVK(0, 0, 0))
+            x[rd] = (x[rd] & ~(0xFFFFull << shift)) | (imm16 << shift);
+        else if ((word & 0xFFC00000u) == A64_ADD_IMM(0, 0, 0))
+            x[rd] = x[rn] + ((word >> 10) & 0xFFFu);
+        else if ((word & 0xFFE0FC00u) == A64_ADD(0, 0, 0))
+            x[rd] = x[rn] + x[rm];
+        else if ((word & 0xFFE0FC00u) == A64_ORR(0, 0, 0))
+            x[rd] = x[rn] | x[rm];
+        else if (word == A64_RET)
+            return 0;
+        else if (word != A64_NOP)
+            return -1;
+    }
+    return -1;
+}
+
+/* amx_jit_sgemm with the emitted tile run on the simulator */
+int amx_jit_sgemm_simulate(float *A, float *B, float *C, const uint64_t sizei, const uint64_t sizej, const uint64_t sizek)
+{
+    if (sizei == 0ull || sizek == 0ull || sizej == 0ull)
+        return 0;
+    if (sizei % 32 != 0 || sizek % 32 != 0 || sizej % 32 != 0)
+        return -1;
+    struct amx_state state;
+    struct amx_jit_code code = {NULL, 0, 0};
+    int result = 0;
+    amx_state_zero(&state);
+    amx_jit_emit_tile(&code, sizek, sizek, sizej, sizej);
+    for (uint64_t i = 0ull; i < sizei && result == 0; i += 16ull)
+        for (uint64_t j = 0ull; j < sizej && result == 0; j += 32ull)
+            result = amx_jit_simulate(&state, code.words, code.size,
+                                      (uint64_t)(A + i * sizek), (uint64_t)(B + j), (uint64_t)(C + i * sizej + j));
+    free(code.words);
+    return result;
+}
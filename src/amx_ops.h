@@ -0,0 +1,84 @@
+#pragma once
+
+#include "../dougallj/amx.h"
+
+/*
+ *  amx registers
+ *  row: a row contains 16 floats or 32 uint16_t or 64 uint8_t or others
+ *  register (groups) x, y and z
+ *  x and y contains 8 rows
+ *  z contains 64 rows
+ */
+
+/*
+ *  Load data to a register row
+ *
+ *  addr: base addr, 0x40 or 0x80 bytes aligin
+ *  offset: in register z, 0x40 bytes per step
+ *  mode: decide load 0x40 bytes with 0 or 0x80 with 1
+ */
+void amx_ldz(const uint8_t *addr, uint64_t offset, uint64_t mode)
+{
+    AMX_LDZ(((mode & 1ull) << 62) |
+            ((offset & ((1ull << 6) - 1)) << 56) |
+            (((uint64_t)addr & ((1ull << 56) - 1))));
+}
+
+/* same as amx_ldz, but store */
+void amx_stz(uint8_t *addr, uint64_t offset, uint64_t mode)
+{
+    AMX_STZ(((mode & 1ull) << 62) |
+            ((offset & ((1ull << 6) - 1)) << 56) |
+            (((uint64_t)addr & ((1ull << 56) - 1))));
+}
+
+/* same as amx_ldz, but offset is limit from 0 to 7 */
+void amx_ldx(uint8_t *addr, uint64_t offset, uint64_t mode)
+{
+    AMX_LDX(((mode & 1ull) << 62) |
+            ((offset & ((1ull << 3) - 1)) << 56) |
+            (((uint64_t)addr & ((1ull << 56) - 1))));
+}
+
+/* same as amx_ldx */
+void amx_ldy(uint8_t *addr, uint64_t offset, uint64_t mode)
+{
+    AMX_LDY(((mode & 1ull) << 62) |
+            ((offset & ((1ull << 3) - 1)) << 56) |
+            (((uint64_t)addr & ((1ull << 56) - 1))));
+}
+
+/* same as amx_ldx, but store */
+void amx_stx(uint8_t *addr, uint64_t offset, uint64_t mode)
+{
+    AMX_STX(((mode & 1ull) << 62) |
+            ((offset & ((1ull << 3) - 1)) << 56) |
+            (((uint64_t)addr & ((1ull << 56) - 1))));
+}
+
+/* same as amx_ldy */
+void amx_sty(uint8_t *addr, uint64_t offset, uint64_t mode)
+{
+    AMX_STY(((mode & 1ull) << 62) |
+            ((offset & ((1ull << 3) - 1)) << 56) |
+            (((uint64_t)addr & ((1ull << 56) - 1))));
+}
+
+/*
+ *  amx float multiply add
+ *  16 floats in a register x row as a vertical vecoter, 
+ *  and 16 floats a in register y row as a horizontal vecoter.
+ *  matrix multiply then and get a 16*16 matirx stored in regiter z
+ *  
+ *  xoffset, yoffset with 0x40 bytes step
+ *  zoffset, 0~63, the value used there is i = zoffset & 0x3
+ *      for float operations i select the rows in z [i, 4 + i, ..., 60 + i]
+ *  zignore, if setted, then the old value in z is not added
+ */
+void amx_fma32(uint64_t xoffset, uint64_t yoffset, uint64_t zoffset, uint64_t zignore)
+{
+    AMX_FMA32((yoffset << 6) |
+              (xoffset << 6 << 10) |
+              (zoffset << 20) |
+              (zignore << 27));
+}
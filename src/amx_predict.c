@@ -0,0 +1,104 @@
+/*
+ *  amx_predict: run the sgemm kernels on the simulator with the timing model
+ *  of dougallj/amx_timing.h and rank them by predicted cycles
+ *
+ *  usage: ./amx_predict [-m] [M N K]...
+ *  without shapes, some square and skinny shapes are predicted
+ *  the cpu copies before AMX_START (transformB) are not counted
+ *  -m: add the cache model of dougallj/amx_memory.h, every kernel starts with
+ *  empty caches and its loads of the lines stored by transformB are penalized
+ */
+
+// compile options: -O3 -DAMX_SIMULATOR -o amx_predict -lm
+
+#include <stdio.h>
+#include <string.h>
+
+#include "amx_sgemm.h"
+#include "../dougallj/amx_timing.h"
+
+#ifndef AMX_SIMULATOR
+#error "amx_predict needs -DAMX_SIMULATOR"
+#endif
+
+static const char *kernel_names[] = {"auto", "no pack", "pack A", "pack AB"};
+
+static const uint64_t default_shapes[][3] = {
+    {64, 64, 64}, {128, 128, 128}, {256, 256, 256}, {512, 512, 512},
+    {32, 512, 512}, {512, 32, 512}, {512, 512, 32},
+};
+
+static void predict_shape(uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    float *A = (float *)aligned_alloc(128, sizei * sizek * sizeof(float));
+    float *B = (float *)aligned_alloc(128, sizek * sizej * sizeof(float));
+    float *C = (float *)aligned_alloc(128, sizei * sizej * sizeof(float));
+    for (uint64_t i = 0; i < sizei * sizek; i++)
+        A[i] = (rand() % 20 + 1) / 100.0;
+    for (uint64_t i = 0; i < sizek * sizej; i++)
+        B[i] = (rand() % 20 + 1) / 100.0;
+
+    enum AMX_SGEMM_KERNEL best_kernel = AMX_SGEMM_AUTO;
+    double best = 0;
+    for (int kernel = AMX_SGEMM_NO_PACK; kernel <= AMX_SGEMM_PACK_AB; kernel++)
+    {
+        if (!amx_sgemm_kernel_supported((enum AMX_SGEMM_KERNEL)kernel, sizei, sizej, sizek))
+            continue;
+        struct amx_memory *memory = amx_timing_memory();
+        if (memory)
+        {
+            amx_memory_flush(memory);
+            amx_memory_reset_stats(memory);
+        }
+        amx_sgemm_run((enum AMX_SGEMM_KERNEL)kernel, A, B, C, sizei, sizej, sizek);
+        const struct amx_timing *timing = amx_timing_last_run();
+        printf("%5llu %5llu %5llu  %-8s %12.0f cycles %9.3f GFLOP/s  fma busy %5.1f%%\n",
+               (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek,
+               kernel_names[kernel], timing->cycles,
+               2.0 * sizei * sizej * sizek * timing->params.frequency_ghz / timing->cycles,
+               100.0 * timing->unit_busy[AMX_UNIT_FMA] / timing->cycles);
+        if (amx_timing_last_memory())
+            amx_memory_print(amx_timing_last_memory(), stdout);
+        if (best_kernel == AMX_SGEMM_AUTO || timing->cycles < best)
+        {
+            best = timing->cycles;
+            best_kernel = (enum AMX_SGEMM_KERNEL)kernel;
+        }
+    }
+    if (best_kernel == AMX_SGEMM_AUTO)
+        printf("skip %llu %llu %llu: no kernel supports it\n",
+               (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek);
+    else
+        printf("%5llu %5llu %5llu  fastest: %s, heuristic: %s\n",
+               (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek,
+               kernel_names[best_kernel], kernel_names[amx_sgemm_heuristic(sizei, sizej, sizek)]);
+
+    free(A);
+    free(B);
+    free(C);
+}
+
+int main(int argc, char **argv)
+{
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-m") == 0)
+    {
+        amx_timing_enable_memory(NULL);
+        arg++;
+    }
+    if ((argc - arg) % 3 != 0)
+    {
+        printf("usage: %s [-m] [M N K]...\n", argv[0]);
+        return -1;
+    }
+    amx_timing_enable(NULL);
+    if (arg == argc)
+    {
+        for (uint64_t s = 0; s < sizeof(default_shapes) / sizeof(default_shapes[0]); s++)
+            predict_shape(default_shapes[s][0], default_shapes[s][1], default_shapes[s][2]);
+    }
+    for (; arg + 2 < argc; arg += 3)
+        predict_shape(strtoull(argv[arg], NULL, 10), strtoull(argv[arg + 1], NULL, 10),
+                      strtoull(argv[arg + 2], NULL, 10));
+    return 0;
+}
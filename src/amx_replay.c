@@ -0,0 +1,72 @@
+/*
+ *  amx_replay: run amx traces (dougallj/amx_trace.h) on the simulator
+ *
+ *  usage: ./amx_replay [-t] trace...
+ *  loads read the memory recorded in the trace, stores are compared to it,
+ *  so a trace recorded on hardware (-DAMX_TRACE) checks the simulator
+ *  -t: also run the timing model of dougallj/amx_timing.h
+ */
+
+// compile options: -O3 -DAMX_SIMULATOR -o amx_replay -lm
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../dougallj/amx.h"
+
+#ifndef AMX_SIMULATOR
+#error "amx_replay needs -DAMX_SIMULATOR"
+#endif
+
+static void timing_hook(void *context, int op, uint64_t operand)
+{
+    amx_timing_issue((struct amx_timing *)context, op, operand);
+}
+
+static int replay(const char *path, int timing)
+{
+    struct amx_trace_reader reader;
+    struct amx_trace_replay_stats stats;
+    struct amx_state state;
+    struct amx_timing model;
+    if (amx_trace_map(&reader, path))
+    {
+        printf("Error: %s is not an amx trace\n", path);
+        return -1;
+    }
+    amx_state_zero(&state);
+    amx_timing_init(&model, NULL);
+    int result = amx_trace_replay(&reader, &state, &stats, timing ? timing_hook : NULL, &model);
+    printf("%s: %llu records, %llu loads, %llu stores, %llu store mismatches",
+           path, (unsigned long long)stats.records, (unsigned long long)stats.loads,
+           (unsigned long long)stats.stores, (unsigned long long)stats.store_mismatches);
+    if (stats.store_mismatches)
+        printf(" (first at record %llu)", (unsigned long long)stats.first_mismatch);
+    printf("\n");
+    if (result)
+        printf("Error: %s is truncated\n", path);
+    if (timing)
+        amx_timing_print(&model, stdout);
+    amx_trace_unmap(&reader);
+    return result || stats.store_mismatches ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int timing = 0;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-t") == 0)
+    {
+        timing = 1;
+        arg++;
+    }
+    if (arg == argc)
+    {
+        printf("usage: %s [-t] trace...\n", argv[0]);
+        return -1;
+    }
+    int result = 0;
+    for (; arg < argc; arg++)
+        result |= replay(argv[arg], timing);
+    return result;
+}
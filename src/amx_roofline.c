@@ -0,0 +1,201 @@
+/*
+ *  amx_roofline: data movement and arithmetic intensity of the sgemm kernels
+ *  on the simulator, against a roofline of the machine
+ *
+ *  usage: ./amx_roofline [-f peak_gflops] [-b amx_gbs] [-d dram_gbs] [-p] [M N K]...
+ *  without shapes, the shapes of amx_predict
+ *
+ *  counts of one call of every kernel:
+ *      fma32 and FLOPs issued, bytes of the amx loads and stores (amx_timing.h)
+ *      bytes written to A0 and B0 by the packing, amx or cpu (amx_sgemm_stats.h)
+ *  intensities:
+ *      amx: FLOPs per byte of amx loads and stores, the traffic to L2
+ *      min: FLOPs per byte of A, B and C once plus the packed copies
+ *  roofs, by default from the timing model:
+ *      -f: fma32 every cycle, 512 FLOPs per cycle
+ *      -b: a 0x40 byte amx load every load_row_cycles
+ *      -d: dram, 68 GB/s (M1)
+ *  the bound of a kernel is the lowest roof at its intensities, the predicted
+ *  GFLOP/s are the ones of amx_predict
+ *  -p writes roofline.dat and roofline.gpi (log-log roofs and kernels)
+ */
+
+// compile options: -O3 -DAMX_SIMULATOR -o amx_roofline -lm
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef AMX_SGEMM_STATS
+#define AMX_SGEMM_STATS
+#endif
+
+#include "amx_sgemm.h"
+#include "../dougallj/amx_timing.h"
+
+#ifndef AMX_SIMULATOR
+#error "amx_roofline needs -DAMX_SIMULATOR"
+#endif
+
+static const char *kernel_names[] = {"auto", "no pack", "pack A", "pack AB"};
+
+static const uint64_t default_shapes[][3] = {
+    {64, 64, 64}, {128, 128, 128}, {256, 256, 256}, {512, 512, 512},
+    {32, 512, 512}, {512, 32, 512}, {512, 512, 32},
+};
+
+struct roofline
+{
+    double peak_gflops;
+    double amx_gbs;
+    double dram_gbs;
+    FILE *data; // roofline.dat, NULL without -p
+};
+
+static double min2(double a, double b)
+{
+    return a < b ? a : b;
+}
+
+static void roofline_shape(const struct roofline *roof, uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    float *A = (float *)aligned_alloc(128, sizei * sizek * sizeof(float));
+    float *B = (float *)aligned_alloc(128, sizek * sizej * sizeof(float));
+    float *C = (float *)aligned_alloc(128, sizei * sizej * sizeof(float));
+    for (uint64_t i = 0; i < sizei * sizek; i++)
+        A[i] = (rand() % 20 + 1) / 100.0;
+    for (uint64_t i = 0; i < sizek * sizej; i++)
+        B[i] = (rand() % 20 + 1) / 100.0;
+
+    int supported = 0;
+    for (int kernel = AMX_SGEMM_NO_PACK; kernel <= AMX_SGEMM_PACK_AB; kernel++)
+    {
+        if (!amx_sgemm_kernel_supported((enum AMX_SGEMM_KERNEL)kernel, sizei, sizej, sizek))
+            continue;
+        supported = 1;
+        struct amx_sgemm_stats before = amx_sgemm_stats_thread();
+        amx_sgemm_run((enum AMX_SGEMM_KERNEL)kernel, A, B, C, sizei, sizej, sizek);
+        struct amx_sgemm_stats after = amx_sgemm_stats_thread();
+        struct amx_sgemm_stats stats = amx_sgemm_stats_diff(&after, &before);
+        const struct amx_timing *timing = amx_timing_last_run();
+
+        double flops = (double)timing->flops;
+        double amx_bytes = (double)(timing->bytes_loaded + timing->bytes_stored);
+        double packed = (double)(stats.bytes_packed_a + stats.bytes_packed_b);
+        double min_bytes = sizeof(float) * (double)(sizei * sizek + sizek * sizej + sizei * sizej) + packed;
+        double amx_intensity = flops / amx_bytes;
+        double min_intensity = flops / min_bytes;
+        double amx_roof = amx_intensity * roof->amx_gbs;
+        double dram_roof = min_intensity * roof->dram_gbs;
+        double attainable = min2(roof->peak_gflops, min2(amx_roof, dram_roof));
+        const char *bound = attainable == roof->peak_gflops ? "compute" : attainable == amx_roof ? "amx load/store" : "dram";
+        double predicted = amx_timing_gflops(timing);
+
+        printf("%5llu %5llu %5llu  %-8s %10llu fma32 %9.3f GFLOP\n",
+               (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek,
+               kernel_names[kernel], (unsigned long long)timing->ops[AMX_OP_FMA32], flops / 1e9);
+        printf("                   amx load %.3f MB, amx store %.3f MB, packed %.3f MB\n",
+               timing->bytes_loaded / 1e6, timing->bytes_stored / 1e6, packed / 1e6);
+        printf("                   intensity amx %.2f, min %.2f FLOP/byte\n", amx_intensity, min_intensity);
+        printf("                   roof %.1f GFLOP/s, %s bound, predicted %.1f GFLOP/s (%.1f%% of roof)\n",
+               attainable, bound, predicted, 100.0 * predicted / attainable);
+        if (roof->data)
+            fprintf(roof->data, "%llux%llux%llu %d %g %g %g\n",
+                    (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek,
+                    kernel, amx_intensity, min_intensity, predicted);
+    }
+    if (!supported)
+        printf("skip %llu %llu %llu: no kernel supports it\n",
+               (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek);
+
+    free(A);
+    free(B);
+    free(C);
+}
+
+/* roofs as functions, kernels as points at their amx intensity, one color per kernel */
+static void write_gnuplot(const struct roofline *roof)
+{
+    FILE *file = fopen("roofline.gpi", "w");
+    if (!file)
+    {
+        printf("cannot write roofline.gpi\n");
+        return;
+    }
+    fprintf(file, "set terminal pngcairo\n");
+    fprintf(file, "set output \"roofline.png\"\n\n");
+    fprintf(file, "set title \"SGEMM kernels, amx_roofline\"\n");
+    fprintf(file, "set xlabel \"FLOP/byte\"\n");
+    fprintf(file, "set ylabel \"GFLOP/s\"\n");
+    fprintf(file, "set logscale xy 2\n");
+    fprintf(file, "set xrange [0.25:1024]\n");
+    fprintf(file, "set key bottom right box\n\n");
+    fprintf(file, "peak = %g\n", roof->peak_gflops);
+    fprintf(file, "amx = %g\n", roof->amx_gbs);
+    fprintf(file, "dram = %g\n", roof->dram_gbs);
+    fprintf(file, "min(a, b) = a < b ? a : b\n\n");
+    fprintf(file, "plot min(peak, amx * x) t \"amx load roof\" lc '#4e79a7' lw 2, \\\n");
+    fprintf(file, "     min(peak, dram * x) t \"dram roof\" lc '#e15759' lw 2 dt 2, \\\n");
+    fprintf(file, "     \"roofline.dat\" u 3:($2 == 1 ? $5 : 1/0) w points pt 7 t \"%s\" lc '#769792', \\\n", kernel_names[1]);
+    fprintf(file, "     \"roofline.dat\" u 3:($2 == 2 ? $5 : 1/0) w points pt 7 t \"%s\" lc '#76b7b2', \\\n", kernel_names[2]);
+    fprintf(file, "     \"roofline.dat\" u 3:($2 == 3 ? $5 : 1/0) w points pt 7 t \"%s\" lc '#76d7d2'\n\n", kernel_names[3]);
+    fprintf(file, "unset output\n");
+    fclose(file);
+}
+
+int main(int argc, char **argv)
+{
+    struct amx_timing_params params = amx_timing_default_params();
+    struct roofline roof;
+    roof.peak_gflops = params.frequency_ghz * 512.0 / params.fma_cycles;
+    roof.amx_gbs = params.frequency_ghz * 64.0 / params.load_row_cycles;
+    roof.dram_gbs = 68.0;
+    roof.data = NULL;
+    int plot = 0;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if (strcmp(argv[arg], "-p") == 0)
+            plot = 1;
+        else if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc)
+            roof.peak_gflops = atof(argv[++arg]);
+        else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc)
+            roof.amx_gbs = atof(argv[++arg]);
+        else if (strcmp(argv[arg], "-d") == 0 && arg + 1 < argc)
+            roof.dram_gbs = atof(argv[++arg]);
+        else
+            break;
+    }
+    if ((argc - arg) % 3 != 0 || (arg < argc && argv[arg][0] == '-'))
+    {
+        printf("usage: %s [-f peak_gflops] [-b amx_gbs] [-d dram_gbs] [-p] [M N K]...\n", argv[0]);
+        return -1;
+    }
+    printf("roofs: %.1f GFLOP/s, amx load %.1f GB/s, dram %.1f GB/s\n",
+           roof.peak_gflops, roof.amx_gbs, roof.dram_gbs);
+    if (plot)
+    {
+        roof.data = fopen("roofline.dat", "w");
+        if (!roof.data)
+        {
+            printf("cannot write roofline.dat\n");
+            return -1;
+        }
+        fprintf(roof.data, "# shape kernel amx_intensity min_intensity predicted_gflops\n");
+    }
+    amx_timing_enable(&params);
+    if (arg == argc)
+    {
+        for (uint64_t s = 0; s < sizeof(default_shapes) / sizeof(default_shapes[0]); s++)
+            roofline_shape(&roof, default_shapes[s][0], default_shapes[s][1], default_shapes[s][2]);
+    }
+    for (; arg + 2 < argc; arg += 3)
+        roofline_shape(&roof, strtoull(argv[arg], NULL, 10), strtoull(argv[arg + 1], NULL, 10),
+                       strtoull(argv[arg + 2], NULL, 10));
+    if (roof.data)
+    {
+        fclose(roof.data);
+        write_gnuplot(&roof);
+    }
+    return 0;
+}
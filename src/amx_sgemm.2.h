@@ -1,92 +1,11 @@
 #pragma once
 
-#include "../dougallj/amx.h"
+#include "amx_ops.h"
+#include "amx_sgemm_stats.h"
 
 #include <stdlib.h>
 
-/*
- *  amx registers
- *  row: a row contains 16 floats or 32 uint16_t or 64 uint8_t or others
- *  register (groups) x, y and z
- *  x and y contains 8 rows
- *  z contains 64 rows
- */
-
-/*
- *  Load data to a register row
- *
- *  addr: base addr, 0x40 or 0x80 bytes aligin
- *  offset: in register z, 0x40 bytes per step
- *  mode: decide load 0x40 bytes with 0 or 0x80 with 1
- */
-void amx_ldz(const uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_LDZ(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 6) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/* same as amx_ldz, but store */
-void amx_stz(uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_STZ(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 6) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/* same as amx_ldz, but offset is limit from 0 to 7 */
-void amx_ldx(uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_LDX(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 3) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/* same as amx_ldx */
-void amx_ldy(uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_LDY(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 3) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/* same as amx_ldx, but store */
-void amx_stx(uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_STX(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 3) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/* same as amx_ldy */
-void amx_sty(uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_STY(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 3) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/*
- *  amx float multiply add
- *  16 floats in a register x row as a vertical vecoter, 
- *  and 16 floats a in register y row as a horizontal vecoter.
- *  matrix multiply then and get a 16*16 matirx stored in regiter z
- *  
- *  xoffset, yoffset with 0x40 bytes step
- *  zoffset, 0~63, the value used there is i = zoffset & 0x3
- *      for float operations i select the rows in z [i, 4 + i, ..., 60 + i]
- *  zignore, if setted, then the old value in z is not added
- */
-void amx_fma32(uint64_t xoffset, uint64_t yoffset, uint64_t zoffset, uint64_t zignore)
-{
-    AMX_FMA32((yoffset << 6) |
-              (xoffset << 6 << 10) |
-              (zoffset << 20) |
-              (zignore << 27));
-}
-
-
-void transformA(const float *A, float *A0, uint64_t sizei, uint64_t sizek)
+void transformA16(const float *A, float *A0, uint64_t sizei, uint64_t sizek)
 {
     for (uint64_t i = 0ull; i < sizei; i += 16ull)
     {
@@ -122,17 +41,21 @@ void transformA(const float *A, float *A0, uint64_t sizei, uint64_t sizek)
     }
 }
 
-void _amx_sgemm(float *A, float *B, float *C, const uint64_t sizei, const uint64_t sizej, const uint64_t sizek)
+void _amx_sgemm_2(float *A, float *B, float *C, const uint64_t sizei, const uint64_t sizej, const uint64_t sizek)
 {
     // limitation
     if (sizei == 0ull || sizek == 0ull || sizej == 0ull)
         return;
     if (sizei % 32 != 0 || sizek % 32 != 0 || sizej % 64 != 0)
         return;
+    AMX_SGEMM_STATS_BEGIN(sizei, sizej, sizek);
+    AMX_SGEMM_STATS_ADD(bytes_packed_a, sizei * sizek * sizeof(float));
     // A0[sizei / 16][sizek][16]
     float *A0 = (float *)aligned_alloc(128, sizei * sizek * sizeof(float));
     AMX_START();
-    transformA(A, A0, sizei, sizek);
+    AMX_SGEMM_STATS_ADD(amx_starts, 1);
+    AMX_SGEMM_STATS_PHASE(AMX_SGEMM_PHASE_PACK_A);
+    transformA16(A, A0, sizei, sizek);
     // 16 rows of A as a row tile
     for (uint64_t i = 0ull; i < sizei; i += 16ull)
     {
@@ -141,6 +64,7 @@ void _amx_sgemm(float *A, float *B, float *C, const uint64_t sizei, const uint64
         for (uint64_t j = 0ull; j < sizej; j += 64ull)
         {
             float *Bj = B + j;
+            AMX_SGEMM_STATS_PHASE(AMX_SGEMM_PHASE_COMPUTE);
             for (uint64_t k = 0ull; k < sizek; k += 2ull)
             {
                 // load A[i:i+16][k:k+2]
@@ -160,6 +84,7 @@ void _amx_sgemm(float *A, float *B, float *C, const uint64_t sizei, const uint64
                 }
             }
             float *Cij = C + i * sizej + j; // C[i][j]
+            AMX_SGEMM_STATS_PHASE(AMX_SGEMM_PHASE_STORE);
             for (uint64_t offset = 0; offset < 16ull; offset++)
             {
                 amx_stz((uint8_t *)(Cij + sizej * offset), (offset << 2), 1ull);
@@ -167,12 +92,15 @@ void _amx_sgemm(float *A, float *B, float *C, const uint64_t sizei, const uint64
             }
         }
     }
+    AMX_SGEMM_STATS_PHASE(-1);
     AMX_STOP();
+    AMX_SGEMM_STATS_ADD(amx_stops, 1);
     free(A0);
+    AMX_SGEMM_STATS_END();
 }
 
-void amx_sgemm(float *A, float *B, float *C, const uint64_t size)
+void amx_sgemm_2(float *A, float *B, float *C, const uint64_t size)
 {
-    _amx_sgemm(A, B, C, size, size, size);
+    _amx_sgemm_2(A, B, C, size, size, size);
     return;
 }
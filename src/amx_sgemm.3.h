@@ -1,89 +1,11 @@
 #pragma once
 
-#include "../dougallj/amx.h"
+#include "amx_ops.h"
+#include "amx_sgemm_stats.h"
+#include "amx_tune.h"
 
 #include <stdlib.h>
-
-/*
- *  amx registers
- *  row: a row contains 16 floats or 32 uint16_t or 64 uint8_t or others
- *  register (groups) x, y and z
- *  x and y contains 8 rows
- *  z contains 64 rows
- */
-
-/*
- *  Load data to a register row
- *
- *  addr: base addr, 0x40 or 0x80 bytes aligin
- *  offset: in register z, 0x40 bytes per step
- *  mode: decide load 0x40 bytes with 0 or 0x80 with 1
- */
-void amx_ldz(const uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_LDZ(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 6) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/* same as amx_ldz, but store */
-void amx_stz(uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_STZ(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 6) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/* same as amx_ldz, but offset is limit from 0 to 7 */
-void amx_ldx(uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_LDX(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 3) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/* same as amx_ldx */
-void amx_ldy(uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_LDY(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 3) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/* same as amx_ldx, but store */
-void amx_stx(uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_STX(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 3) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/* same as amx_ldy */
-void amx_sty(uint8_t *addr, uint64_t offset, uint64_t mode)
-{
-    AMX_STY(((mode & 1ull) << 62) |
-            ((offset & ((1ull << 3) - 1)) << 56) |
-            (((uint64_t)addr & ((1ull << 56) - 1))));
-}
-
-/*
- *  amx float multiply add
- *  16 floats in a register x row as a vertical vecoter, 
- *  and 16 floats a in register y row as a horizontal vecoter.
- *  matrix multiply then and get a 16*16 matirx stored in regiter z
- *  
- *  xoffset, yoffset with 0x40 bytes step
- *  zoffset, 0~63, the value used there is i = zoffset & 0x3
- *      for float operations i select the rows in z [i, 4 + i, ..., 60 + i]
- *  zignore, if setted, then the old value in z is not added
- */
-void amx_fma32(uint64_t xoffset, uint64_t yoffset, uint64_t zoffset, uint64_t zignore)
-{
-    AMX_FMA32((yoffset << 6) |
-              (xoffset << 6 << 10) |
-              (zoffset << 20) |
-              (zignore << 27));
-}
+#include <string.h>
 
 void transformA(const float *A, float *A0, uint64_t sizei, uint64_t sizek)
 {
@@ -137,66 +59,193 @@ void transformB(const float *B, float *B0, uint64_t sizek, uint64_t sizej)
         for (uint64_t k = 0; k < sizek; k++)
         {
             memcpy(B0, &B[sizej * k + j], sizeof(float) * 32);
+            AMX_NOTE_CPU_STORE(B0, sizeof(float) * 32);
             B0 += 32;
         }
     }
 }
 
-void _amx_sgemm(float *A, float *B, float *C, const uint64_t sizei, const uint64_t sizej, const uint64_t sizek)
+/*
+ *  storage order and transpose flags, the values are the same as cblas
+ *
+ *  a column major matrix is the transpose of a row major matrix in memory,
+ *  so they are handled by swapping operands and packing, never by a copy
+ */
+enum AMX_ORDER
+{
+    AMX_ROW_MAJOR = 101,
+    AMX_COL_MAJOR = 102
+};
+
+enum AMX_TRANSPOSE
 {
+    AMX_NO_TRANS = 111,
+    AMX_TRANS = 112
+};
+
+/*
+ *  compute a 32x32 tile C[i:i+32][j:j+32] with packed A0 and B0
+ *
+ *  A0i: A0[i / 32], B0j: B0[j / 32]
+ *  unroll: k steps per iteration, their A and B rows go to y and x rows (k << 1)
+ */
+static inline __attribute__((always_inline)) void amx_sgemm_tile_unroll(const float *A0i, const float *B0j, float *Cij,
+                                                                        const uint64_t sizej, const uint64_t sizek,
+                                                                        const uint64_t unroll)
+{
+    AMX_SGEMM_STATS_PHASE(AMX_SGEMM_PHASE_COMPUTE);
+    for (uint64_t k = 0ull; k < sizek; k += unroll)
+    {
+        for (uint64_t u = 0ull; u < unroll; u++)
+        {
+            // load A[i:i+32][k+u]
+            amx_ldy((uint8_t *)(A0i + 32ull * (k + u)), u << 1, 1ull);
+            // load B[k+u][j:j+32]
+            amx_ldx((uint8_t *)(B0j + 32ull * (k + u)), u << 1, 1ull);
+        }
+        for (uint64_t u = 0ull; u < unroll; u++)
+        {
+            uint64_t zignore = k == 0ull && u == 0ull ? 1ull : 0ull;
+            // fma32 A[i:i+16][k+u] B[k+u][j:j+16]
+            amx_fma32((u << 1) + 0ull, (u << 1) + 0ull, 0ull, zignore);
+            // fma32 A[i:i+16][k+u] B[k+u][j+16:j+32]
+            amx_fma32((u << 1) + 1ull, (u << 1) + 0ull, 1ull, zignore);
+            // fma32 A[i+16:i+32][k+u] B[k+u][j:j+16]
+            amx_fma32((u << 1) + 0ull, (u << 1) + 1ull, 2ull, zignore);
+            // fma32 A[i+16:i+32][k+u] B[k+u][j+16:j+32]
+            amx_fma32((u << 1) + 1ull, (u << 1) + 1ull, 3ull, zignore);
+        }
+    }
+    AMX_SGEMM_STATS_PHASE(AMX_SGEMM_PHASE_STORE);
+    for (uint64_t offset = 0; offset < 16ull; offset++)
+    {
+        amx_stz((uint8_t *)(Cij + sizej * offset), (offset << 2), 1ull);
+        amx_stz((uint8_t *)(Cij + sizej * (offset + 16ull)), (offset << 2) + 2ull, 1ull);
+    }
+}
+
+void amx_sgemm_tile(const float *A0i, const float *B0j, float *Cij,
+                    const uint64_t sizej, const uint64_t sizek, const uint64_t unroll)
+{
+    // constant unroll, so every variant is a fully unrolled loop
+    if (unroll == 4ull && sizek % 4ull == 0ull)
+        amx_sgemm_tile_unroll(A0i, B0j, Cij, sizej, sizek, 4ull);
+    else if (unroll == 2ull && sizek % 2ull == 0ull)
+        amx_sgemm_tile_unroll(A0i, B0j, Cij, sizej, sizek, 2ull);
+    else
+        amx_sgemm_tile_unroll(A0i, B0j, Cij, sizej, sizek, 1ull);
+}
+
+/*
+ *  compute C with packed A0 and B0, amx should be started
+ *
+ *  A0[sizei / 32][sizek][2][16], from transformA
+ *  B0[sizej / 32][sizek][2][16], from transformB
+ *  config: blocking, loop order and unroll, see amx_tune.h
+ */
+void amx_sgemm_packed(const float *A0, const float *B0, float *C,
+                      const uint64_t sizei, const uint64_t sizej, const uint64_t sizek,
+                      const struct amx_sgemm_config *config)
+{
+    // dimension 0 is the outer one
+    const int ij = config->order == AMX_LOOP_IJ;
+    const uint64_t size0 = ij ? sizei : sizej;
+    const uint64_t size1 = ij ? sizej : sizei;
+    const uint64_t blocks_i = config->block_i ? config->block_i << 5 : sizei;
+    const uint64_t blocks_j = config->block_j ? config->block_j << 5 : sizej;
+    const uint64_t block0 = ij ? blocks_i : blocks_j;
+    const uint64_t block1 = ij ? blocks_j : blocks_i;
+    for (uint64_t b0 = 0ull; b0 < size0; b0 += block0)
+    {
+        const uint64_t end0 = b0 + block0 < size0 ? b0 + block0 : size0;
+        for (uint64_t b1 = 0ull; b1 < size1; b1 += block1)
+        {
+            const uint64_t end1 = b1 + block1 < size1 ? b1 + block1 : size1;
+            for (uint64_t t0 = b0; t0 < end0; t0 += 32ull)
+            {
+                for (uint64_t t1 = b1; t1 < end1; t1 += 32ull)
+                {
+                    const uint64_t i = ij ? t0 : t1;
+                    const uint64_t j = ij ? t1 : t0;
+                    amx_sgemm_tile(A0 + i * sizek, B0 + j * sizek, C + i * sizej + j, sizej, sizek, config->unroll);
+                }
+            }
+        }
+    }
+}
+
+/*
+ *  C = op(A) * op(B), like cblas_sgemm with alpha 1, beta 0 and no leading dimensions
+ *
+ *  sizei, sizej, sizek: rows of op(A), columns of op(B), columns of op(A)
+ *
+ *  A0 rows are columns of A and B0 rows are rows of B, so an A given as A^T
+ *  is packed by the row copy of transformB, and a B given as B^T is packed by
+ *  the transpose of transformA, both at the same cost as the untransposed one.
+ */
+void amx_sgemm_ex(enum AMX_ORDER order, enum AMX_TRANSPOSE transA, enum AMX_TRANSPOSE transB,
+                  const float *A, const float *B, float *C,
+                  const uint64_t sizei, const uint64_t sizej, const uint64_t sizek)
+{
+    // limitation, other values would leave A0 or B0 unpacked
+    if (order != AMX_ROW_MAJOR && order != AMX_COL_MAJOR)
+        return;
+    if ((transA != AMX_NO_TRANS && transA != AMX_TRANS) || (transB != AMX_NO_TRANS && transB != AMX_TRANS))
+        return;
+    // column major C = op(A) * op(B) is row major C^T = op(B)^T * op(A)^T
+    if (order == AMX_COL_MAJOR)
+    {
+        amx_sgemm_ex(AMX_ROW_MAJOR, transB, transA, B, A, C, sizej, sizei, sizek);
+        return;
+    }
     // limitation
     if (sizei == 0ull || sizek == 0ull || sizej == 0ull)
         return;
     if (sizei % 32 != 0 || sizek % 32 != 0 || sizej % 32 != 0)
         return;
+    AMX_SGEMM_STATS_BEGIN(sizei, sizej, sizek);
+    AMX_SGEMM_STATS_ADD(bytes_packed_a, sizei * sizek * sizeof(float));
+    AMX_SGEMM_STATS_ADD(bytes_packed_b, sizek * sizej * sizeof(float));
     // A0[sizei / 32][sizek][2][16]
     float *A0 = (float *)aligned_alloc(128, sizei * sizek * sizeof(float));
     // B0[sizej / 32][sizek][2][16]
     float *B0 = (float *)aligned_alloc(128, sizek * sizej * sizeof(float));
 
-    transformB(B, B0, sizek, sizej);
+    // row copies by cpu
+    AMX_SGEMM_STATS_PHASE(AMX_SGEMM_PHASE_PACK_B);
+    if (transB == AMX_NO_TRANS)
+        transformB(B, B0, sizek, sizej);
+    AMX_SGEMM_STATS_PHASE(AMX_SGEMM_PHASE_PACK_A);
+    if (transA == AMX_TRANS)
+        transformB(A, A0, sizek, sizei);
+    AMX_SGEMM_STATS_PHASE(-1);
     AMX_START();
-    transformA(A, A0, sizei, sizek);
-    // 2 * 16 rows of A as a row tile
-    for (uint64_t i = 0ull; i < sizei; i += 32ull)
-    {
-        float *A0i = A0 + i * sizek;
-        // 2 * 16 columns of B as a column tile
-        for (uint64_t j = 0ull; j < sizej; j += 32ull)
-        {
-            float *B0j = B0 + j * sizek;
-            for (uint64_t k = 0ull; k < sizek; k += 1ull)
-            {
-                // load A[i:i+32][k]
-                amx_ldy((uint8_t *)(A0i + 32ull * k), 0ull, 1ull);
-                // load B[k][j:j+32]
-                amx_ldx((uint8_t *)(B0j + 32ull * k), 0ull, 1ull);
-
-                uint64_t zignore = k == 0ull ? 1ull : 0ull;
-                // fma32 A[i:i+16][k] B[k][j:j+16]
-                amx_fma32(0ull, 0ull, 0ull, zignore);
-                // fma32 A[i:i+16][k] B[k][j+16:j+32]
-                amx_fma32(1ull, 0ull, 1ull, zignore);
-                // fma32 A[i+16:i+32][k] B[k][j:j+16]
-                amx_fma32(0ull, 1ull, 2ull, zignore);
-                // fma32 A[i+16:i+32][k] B[k][j+16:j+32]
-                amx_fma32(1ull, 1ull, 3ull, zignore);
-            }
-            float *Cij = C + i * sizej + j; // C[i][j]
-            for (uint64_t offset = 0; offset < 16ull; offset++)
-            {
-                amx_stz((uint8_t *)(Cij + sizej * offset), (offset << 2), 1ull);
-                amx_stz((uint8_t *)(Cij + sizej * (offset + 16ull)), (offset << 2) + 2ull, 1ull);
-            }
-        }
-    }
+    AMX_SGEMM_STATS_ADD(amx_starts, 1);
+    // transposes by amx
+    AMX_SGEMM_STATS_PHASE(AMX_SGEMM_PHASE_PACK_A);
+    if (transA == AMX_NO_TRANS)
+        transformA(A, A0, sizei, sizek);
+    AMX_SGEMM_STATS_PHASE(AMX_SGEMM_PHASE_PACK_B);
+    if (transB == AMX_TRANS)
+        transformA(B, B0, sizej, sizek);
+    AMX_SGEMM_STATS_PHASE(-1);
+    struct amx_sgemm_config config = amx_tune_lookup(sizei, sizej, sizek);
+    amx_sgemm_packed(A0, B0, C, sizei, sizej, sizek, &config);
+    AMX_SGEMM_STATS_PHASE(-1);
     AMX_STOP();
+    AMX_SGEMM_STATS_ADD(amx_stops, 1);
     free(A0);
     free(B0);
+    AMX_SGEMM_STATS_END();
+}
+
+void _amx_sgemm_3(float *A, float *B, float *C, const uint64_t sizei, const uint64_t sizej, const uint64_t sizek)
+{
+    amx_sgemm_ex(AMX_ROW_MAJOR, AMX_NO_TRANS, AMX_NO_TRANS, A, B, C, sizei, sizej, sizek);
 }
 
-void amx_sgemm(float *A, float *B, float *C, const uint64_t size)
+void amx_sgemm_3(float *A, float *B, float *C, const uint64_t size)
 {
-    _amx_sgemm(A, B, C, size, size, size);
+    _amx_sgemm_3(A, B, C, size, size, size);
     return;
 }
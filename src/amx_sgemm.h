@@ -1,2 +1,179 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
 #include "amx_sgemm.1.h"
+#include "amx_sgemm.2.h"
+#include "amx_sgemm.3.h"
+
+/*
+ *  kernels behind _amx_sgemm, one is picked for every call
+ *
+ *  AMX_SGEMM_NO_PACK, amx_sgemm.1.h: no allocation, blocks of A are transposed
+ *      by ldz + extry, again for every 32 columns of C
+ *  AMX_SGEMM_PACK_A, amx_sgemm.2.h: A is packed once, B is loaded in place, 16x64 tiles
+ *  AMX_SGEMM_PACK_AB, amx_sgemm.3.h: A and B are packed, 32x32 tiles
+ */
+enum AMX_SGEMM_KERNEL
+{
+    AMX_SGEMM_AUTO = 0,
+    AMX_SGEMM_NO_PACK = 1,
+    AMX_SGEMM_PACK_A = 2,
+    AMX_SGEMM_PACK_AB = 3
+};
+
+#define AMX_SGEMM_MAX_CALIBRATION 256
+
+struct amx_sgemm_calibration_entry
+{
+    uint64_t bucket_i;
+    uint64_t bucket_j;
+    uint64_t bucket_k;
+    enum AMX_SGEMM_KERNEL kernel;
+};
+
+/* forced with $AMX_SGEMM_KERNEL=1, 2 or 3 */
+static enum AMX_SGEMM_KERNEL amx_sgemm_kernel_override = AMX_SGEMM_AUTO;
+
+/* fastest kernel of shape buckets (see amx_tune_bucket), from amx_sgemm_calibrate */
+static struct amx_sgemm_calibration_entry amx_sgemm_calibration[AMX_SGEMM_MAX_CALIBRATION];
+static uint64_t amx_sgemm_calibration_size = 0;
+
+int amx_sgemm_kernel_supported(enum AMX_SGEMM_KERNEL kernel, uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    if (sizei == 0ull || sizek == 0ull || sizej == 0ull)
+        return 0;
+    if (sizei % 32 != 0 || sizek % 32 != 0 || sizej % 32 != 0)
+        return 0;
+    if (kernel == AMX_SGEMM_PACK_A)
+        return sizej % 64 == 0;
+    return kernel == AMX_SGEMM_NO_PACK || kernel == AMX_SGEMM_PACK_AB;
+}
+
+/*
+ *  packing A pays off when a block of A is used by more than one column tile of C,
+ *  packing B pays off when a block of B is used by more than a few row tiles of C
+ */
+enum AMX_SGEMM_KERNEL amx_sgemm_heuristic(uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    if (sizej <= 32ull)
+        return AMX_SGEMM_NO_PACK;
+    if (sizei <= 64ull && amx_sgemm_kernel_supported(AMX_SGEMM_PACK_A, sizei, sizej, sizek))
+        return AMX_SGEMM_PACK_A;
+    return AMX_SGEMM_PACK_AB;
+}
+
+static struct amx_sgemm_calibration_entry *amx_sgemm_calibration_find(uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    uint64_t bucket_i = amx_tune_bucket(sizei);
+    uint64_t bucket_j = amx_tune_bucket(sizej);
+    uint64_t bucket_k = amx_tune_bucket(sizek);
+    for (uint64_t e = 0; e < amx_sgemm_calibration_size; e++)
+    {
+        struct amx_sgemm_calibration_entry *entry = &amx_sgemm_calibration[e];
+        if (entry->bucket_i == bucket_i && entry->bucket_j == bucket_j && entry->bucket_k == bucket_k)
+            return entry;
+    }
+    return NULL;
+}
+
+/* override, then calibration, then heuristics */
+enum AMX_SGEMM_KERNEL amx_sgemm_choose(uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    if (amx_sgemm_kernel_supported(amx_sgemm_kernel_override, sizei, sizej, sizek))
+        return amx_sgemm_kernel_override;
+    struct amx_sgemm_calibration_entry *entry = amx_sgemm_calibration_find(sizei, sizej, sizek);
+    if (entry && amx_sgemm_kernel_supported(entry->kernel, sizei, sizej, sizek))
+        return entry->kernel;
+    return amx_sgemm_heuristic(sizei, sizej, sizek);
+}
+
+void amx_sgemm_run(enum AMX_SGEMM_KERNEL kernel, float *A, float *B, float *C,
+                   const uint64_t sizei, const uint64_t sizej, const uint64_t sizek)
+{
+    switch (kernel)
+    {
+    case AMX_SGEMM_NO_PACK:
+        _amx_sgemm_1(A, B, C, sizei, sizej, sizek);
+        break;
+    case AMX_SGEMM_PACK_A:
+        _amx_sgemm_2(A, B, C, sizei, sizej, sizek);
+        break;
+    default:
+        _amx_sgemm_3(A, B, C, sizei, sizej, sizek);
+        break;
+    }
+}
+
+void _amx_sgemm(float *A, float *B, float *C, const uint64_t sizei, const uint64_t sizej, const uint64_t sizek)
+{
+    amx_sgemm_run(amx_sgemm_choose(sizei, sizej, sizek), A, B, C, sizei, sizej, sizek);
+}
+
+void amx_sgemm(float *A, float *B, float *C, const uint64_t size)
+{
+    _amx_sgemm(A, B, C, size, size, size);
+}
+
+/*
+ *  time every supported kernel on a shape and use the fastest for its bucket
+ *  not thread safe, calibrate before starting threads
+ */
+enum AMX_SGEMM_KERNEL amx_sgemm_calibrate(const uint64_t sizei, const uint64_t sizej, const uint64_t sizek)
+{
+    enum AMX_SGEMM_KERNEL best_kernel = amx_sgemm_heuristic(sizei, sizej, sizek);
+    if (!amx_sgemm_kernel_supported(best_kernel, sizei, sizej, sizek))
+        return best_kernel;
+    float *A = (float *)aligned_alloc(128, sizei * sizek * sizeof(float));
+    float *B = (float *)aligned_alloc(128, sizek * sizej * sizeof(float));
+    float *C = (float *)aligned_alloc(128, sizei * sizej * sizeof(float));
+    for (uint64_t i = 0; i < sizei * sizek; i++)
+        A[i] = (rand() % 20 + 1) / 100.0;
+    for (uint64_t i = 0; i < sizek * sizej; i++)
+        B[i] = (rand() % 20 + 1) / 100.0;
+
+    uint64_t best = UINT64_MAX;
+    for (int kernel = AMX_SGEMM_NO_PACK; kernel <= AMX_SGEMM_PACK_AB; kernel++)
+    {
+        if (!amx_sgemm_kernel_supported((enum AMX_SGEMM_KERNEL)kernel, sizei, sizej, sizek))
+            continue;
+        // first run is warm up
+        for (int r = 0; r < 4; r++)
+        {
+            struct timeval start, end;
+            gettimeofday(&start, NULL);
+            amx_sgemm_run((enum AMX_SGEMM_KERNEL)kernel, A, B, C, sizei, sizej, sizek);
+            gettimeofday(&end, NULL);
+            uint64_t diff = 1000000ull * (end.tv_sec - start.tv_sec) + end.tv_usec - start.tv_usec;
+            if (r > 0 && diff < best)
+            {
+                best = diff;
+                best_kernel = (enum AMX_SGEMM_KERNEL)kernel;
+            }
+        }
+    }
+    free(A);
+    free(B);
+    free(C);
+
+    struct amx_sgemm_calibration_entry *entry = amx_sgemm_calibration_find(sizei, sizej, sizek);
+    if (entry == NULL && amx_sgemm_calibration_size < AMX_SGEMM_MAX_CALIBRATION)
+    {
+        entry = &amx_sgemm_calibration[amx_sgemm_calibration_size++];
+        entry->bucket_i = amx_tune_bucket(sizei);
+        entry->bucket_j = amx_tune_bucket(sizej);
+        entry->bucket_k = amx_tune_bucket(sizek);
+    }
+    if (entry)
+        entry->kernel = best_kernel;
+    return best_kernel;
+}
 
+__attribute__((constructor)) static void amx_sgemm_init(void)
+{
+    const char *kernel = getenv("AMX_SGEMM_KERNEL");
+    if (kernel)
+        amx_sgemm_kernel_override = (enum AMX_SGEMM_KERNEL)atoi(kernel);
+}
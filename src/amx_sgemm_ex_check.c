@@ -0,0 +1,144 @@
+/*
+ *  amx_sgemm_ex_check: amx_sgemm_ex on the simulator against a double reference,
+ *  for every order and transpose of A and B
+ *
+ *  usage: ./amx_sgemm_ex_check [M N K]...
+ *  without shapes, some square and skinny shapes
+ *  also checks that invalid order or transpose values leave C untouched
+ *  returns 1 if a relative error is over 1e-5
+ */
+
+// compile options: -O3 -DAMX_SIMULATOR -o amx_sgemm_ex_check -lm
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "amx_sgemm.h"
+
+#ifndef AMX_SIMULATOR
+#error "amx_sgemm_ex_check needs -DAMX_SIMULATOR"
+#endif
+
+static const uint64_t default_shapes[][3] = {
+    {32, 32, 32}, {64, 96, 32}, {128, 64, 96}, {32, 128, 64}, {96, 32, 128},
+};
+
+/* element r, c of a rows x cols matrix */
+static float element(const float *X, int row_major, uint64_t r, uint64_t c, uint64_t rows, uint64_t cols)
+{
+    return row_major ? X[r * cols + c] : X[c * rows + r];
+}
+
+static int check(enum AMX_ORDER order, enum AMX_TRANSPOSE transA, enum AMX_TRANSPOSE transB,
+                 const float *A, const float *B, float *C, uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    int row_major = order == AMX_ROW_MAJOR;
+    for (uint64_t i = 0; i < sizei * sizej; i++)
+        C[i] = NAN;
+    amx_sgemm_ex(order, transA, transB, A, B, C, sizei, sizej, sizek);
+    double error = 0.0;
+    for (uint64_t i = 0; i < sizei; i++)
+    {
+        for (uint64_t j = 0; j < sizej; j++)
+        {
+            double ref = 0.0;
+            for (uint64_t k = 0; k < sizek; k++)
+            {
+                float a = transA == AMX_NO_TRANS ? element(A, row_major, i, k, sizei, sizek)
+                                                 : element(A, row_major, k, i, sizek, sizei);
+                float b = transB == AMX_NO_TRANS ? element(B, row_major, k, j, sizek, sizej)
+                                                 : element(B, row_major, j, k, sizej, sizek);
+                ref += (double)a * b;
+            }
+            double c = element(C, row_major, i, j, sizei, sizej);
+            double e = fabs(c - ref) / fabs(ref);
+            error = e > error || isnan(e) ? e : error;
+        }
+    }
+    int failed = !(error <= 1e-5);
+    printf("%5llu %5llu %5llu  %s %s %s: max relative error %g%s\n",
+           (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek,
+           row_major ? "row major" : "col major", transA == AMX_TRANS ? "A^T" : "A  ",
+           transB == AMX_TRANS ? "B^T" : "B  ", error, failed ? ", FAILED" : "");
+    return failed;
+}
+
+static int check_shape(uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    if (sizei % 32 != 0 || sizej % 32 != 0 || sizek % 32 != 0 || sizei == 0 || sizej == 0 || sizek == 0)
+    {
+        printf("skip %llu %llu %llu: sizes must be non zero multiples of 32\n",
+               (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek);
+        return 0;
+    }
+    float *A = (float *)aligned_alloc(128, sizei * sizek * sizeof(float));
+    float *B = (float *)aligned_alloc(128, sizek * sizej * sizeof(float));
+    float *C = (float *)aligned_alloc(128, sizei * sizej * sizeof(float));
+    for (uint64_t i = 0; i < sizei * sizek; i++)
+        A[i] = (rand() % 20 + 1) / 100.0;
+    for (uint64_t i = 0; i < sizek * sizej; i++)
+        B[i] = (rand() % 20 + 1) / 100.0;
+
+    static const enum AMX_ORDER orders[] = {AMX_ROW_MAJOR, AMX_COL_MAJOR};
+    static const enum AMX_TRANSPOSE transposes[] = {AMX_NO_TRANS, AMX_TRANS};
+    int failed = 0;
+    for (int o = 0; o < 2; o++)
+        for (int ta = 0; ta < 2; ta++)
+            for (int tb = 0; tb < 2; tb++)
+                failed |= check(orders[o], transposes[ta], transposes[tb], A, B, C, sizei, sizej, sizek);
+
+    free(A);
+    free(B);
+    free(C);
+    return failed;
+}
+
+/* invalid enums are rejected like invalid sizes, C is not written */
+static int check_invalid(void)
+{
+    float *A = (float *)aligned_alloc(128, 32 * 32 * sizeof(float));
+    float *B = (float *)aligned_alloc(128, 32 * 32 * sizeof(float));
+    float *C = (float *)aligned_alloc(128, 32 * 32 * sizeof(float));
+    for (uint64_t i = 0; i < 32 * 32; i++)
+        A[i] = B[i] = 1.0f;
+    int failed = 0;
+    for (int call = 0; call < 3; call++)
+    {
+        for (uint64_t i = 0; i < 32 * 32; i++)
+            C[i] = -1.0f;
+        if (call == 0)
+            amx_sgemm_ex((enum AMX_ORDER)0, AMX_NO_TRANS, AMX_NO_TRANS, A, B, C, 32, 32, 32);
+        else if (call == 1)
+            amx_sgemm_ex(AMX_ROW_MAJOR, (enum AMX_TRANSPOSE)113, AMX_NO_TRANS, A, B, C, 32, 32, 32);
+        else
+            amx_sgemm_ex(AMX_COL_MAJOR, AMX_NO_TRANS, (enum AMX_TRANSPOSE)0, A, B, C, 32, 32, 32);
+        for (uint64_t i = 0; i < 32 * 32; i++)
+            failed |= C[i] != -1.0f;
+    }
+    printf("invalid order and transpose values: %s\n", failed ? "C written, FAILED" : "rejected");
+    free(A);
+    free(B);
+    free(C);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    if ((argc - 1) % 3 != 0)
+    {
+        printf("usage: %s [M N K]...\n", argv[0]);
+        return -1;
+    }
+    int failed = check_invalid();
+    if (argc == 1)
+    {
+        for (uint64_t s = 0; s < sizeof(default_shapes) / sizeof(default_shapes[0]); s++)
+            failed |= check_shape(default_shapes[s][0], default_shapes[s][1], default_shapes[s][2]);
+    }
+    for (int arg = 1; arg + 2 < argc; arg += 3)
+        failed |= check_shape(strtoull(argv[arg], NULL, 10), strtoull(argv[arg + 1], NULL, 10),
+                              strtoull(argv[arg + 2], NULL, 10));
+    printf(failed ? "FAILED\n" : "passed\n");
+    return failed;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+/*
+ *  amx::gemm<M, N, K>: C = A * B for small row major matrices of fixed size
+ *
+ *  the same scheme as amx_sgemm.1.h (16 rows of A transposed in z, 16x32 tiles
+ *  of C in z rows 0 and 1 mod 4), but every loop is unrolled by templates, so
+ *  all operands except the matrix addresses are compile time constants and
+ *  there are no loop counters or zignore branches between amx instructions
+ *
+ *  M, N, K: multiples of 16
+ *  A, B, C: 0x80 bytes aligned
+ */
+
+#ifndef __cplusplus
+#error "amx_sgemm_small.h needs C++17"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "../dougallj/amx.h"
+
+namespace amx
+{
+
+namespace detail
+{
+
+template <class F, std::size_t... I>
+inline __attribute__((always_inline)) void static_for(F &&f, std::index_sequence<I...>)
+{
+    (f(std::integral_constant<std::size_t, I>{}), ...);
+}
+
+/* f(integral_constant<0>) ... f(integral_constant<N - 1>) */
+template <std::size_t N, class F>
+inline __attribute__((always_inline)) void static_for(F &&f)
+{
+    static_for(f, std::make_index_sequence<N>{});
+}
+
+constexpr uint64_t ldst(uint64_t offset, uint64_t mode)
+{
+    return (mode << 62) | (offset << 56);
+}
+
+constexpr uint64_t fma32(uint64_t xoffset, uint64_t yoffset, uint64_t zoffset, uint64_t zignore)
+{
+    return (yoffset << 6) | (xoffset << 6 << 10) | (zoffset << 20) | (zignore << 27);
+}
+
+/* move column (column + i) of the A block in z rows 2 mod 4 to y row i, see transpose_Z_to_Y */
+constexpr uint64_t extry(uint64_t column, uint64_t i)
+{
+    return 0x8000000010004000ull | ((((column + i) << 2) + 2ull) << 20) | (i << 6);
+}
+
+/* C[I0:I0+16][J0:J0+W] with W 16 or 32 */
+template <uint64_t N, uint64_t K, uint64_t I0, uint64_t J0, uint64_t W>
+inline __attribute__((always_inline)) void tile(const float *A, const float *B, float *C)
+{
+    // 0x80 bytes rows are only aligned if N is a multiple of 32, otherwise use two 0x40 bytes
+    constexpr bool pair = W == 32 && N % 32 == 0;
+    static_for<K / 16>([&](auto kb) {
+        constexpr uint64_t k0 = decltype(kb)::value * 16;
+        // load A[I0:I0+16][k0:k0+16] to z rows 2 mod 4
+        static_for<16>([&](auto r) {
+            constexpr uint64_t row = decltype(r)::value;
+            AMX_LDZ((uint64_t)(A + (I0 + row) * K + k0) | ldst((row << 2) + 2ull, 0ull));
+        });
+        static_for<4>([&](auto l) {
+            constexpr uint64_t L = decltype(l)::value;
+            // load B[k0+L*4:k0+L*4+4][J0:J0+W] to x rows 0, 2, 4, 6
+            static_for<4>([&](auto q) {
+                constexpr uint64_t Q = decltype(q)::value;
+                const float *Bk = B + (k0 + L * 4 + Q) * N + J0;
+                if constexpr (pair)
+                    AMX_LDX((uint64_t)Bk | ldst(Q << 1, 1ull));
+                else
+                    static_for<W / 16>([&](auto h) {
+                        AMX_LDX((uint64_t)(Bk + decltype(h)::value * 16) | ldst((Q << 1) + decltype(h)::value, 0ull));
+                    });
+            });
+            // columns 0~8 of the A block to y for L 0 and 1, columns 8~16 for L 2 and 3
+            if constexpr (L % 2 == 0)
+            {
+                static_for<8>([&](auto i) {
+                    AMX_EXTRY(extry((L >> 1) << 3, decltype(i)::value));
+                });
+            }
+            static_for<4>([&](auto m) {
+                constexpr uint64_t M_ = decltype(m)::value;
+                constexpr uint64_t zignore = k0 == 0 && L == 0 && M_ == 0 ? 1ull : 0ull;
+                constexpr uint64_t yoffset = M_ + ((L & 1ull) << 2);
+                AMX_FMA32(fma32(M_ << 1, yoffset, 0ull, zignore));
+                if constexpr (W == 32)
+                    AMX_FMA32(fma32((M_ << 1) + 1ull, yoffset, 1ull, zignore));
+            });
+        });
+    });
+    // z rows 4r and 4r+1 are C[I0+r][J0:J0+W]
+    static_for<16>([&](auto r) {
+        constexpr uint64_t row = decltype(r)::value;
+        float *Ci = C + (I0 + row) * N + J0;
+        if constexpr (pair)
+            AMX_STZ((uint64_t)Ci | ldst(row << 2, 1ull));
+        else
+            static_for<W / 16>([&](auto h) {
+                AMX_STZ((uint64_t)(Ci + decltype(h)::value * 16) | ldst((row << 2) + decltype(h)::value, 0ull));
+            });
+    });
+}
+
+} // namespace detail
+
+/* amx should be started, for chaining many small gemms in one AMX_START/AMX_STOP */
+template <uint64_t M, uint64_t N, uint64_t K>
+inline void gemm_kernel(const float *A, const float *B, float *C)
+{
+    static_assert(M > 0 && N > 0 && K > 0, "sizes should not be 0");
+    static_assert(M % 16 == 0 && N % 16 == 0 && K % 16 == 0, "sizes should be multiples of 16");
+    detail::static_for<M / 16>([&](auto i) {
+        constexpr uint64_t I0 = decltype(i)::value * 16;
+        detail::static_for<(N + 31) / 32>([&](auto j) {
+            constexpr uint64_t J0 = decltype(j)::value * 32;
+            constexpr uint64_t W = N - J0 >= 32 ? 32 : 16;
+            detail::tile<N, K, I0, J0, W>(A, B, C);
+        });
+    });
+}
+
+template <uint64_t M, uint64_t N, uint64_t K>
+inline void gemm(const float *A, const float *B, float *C)
+{
+    AMX_START();
+    gemm_kernel<M, N, K>(A, B, C);
+    AMX_STOP();
+}
+
+} // namespace amx
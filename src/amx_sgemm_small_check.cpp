@@ -0,0 +1,90 @@
+/*
+ *  amx_sgemm_small_check: amx::gemm and amx::gemm_kernel (amx_sgemm_small.h)
+ *  on the simulator against a double reference
+ *
+ *  usage: ./amx_sgemm_small_check
+ *  the shapes are template arguments, so they are fixed: square ones, and ones
+ *  with N % 32 == 16 that end in a half tile
+ *  returns 1 if a relative error is over 1e-5
+ */
+
+// compile options: -O3 -std=c++17 -DAMX_SIMULATOR -o amx_sgemm_small_check -lm
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "amx_sgemm_small.h"
+
+#ifndef AMX_SIMULATOR
+#error "amx_sgemm_small_check needs -DAMX_SIMULATOR"
+#endif
+
+static double max_error(const float *A, const float *B, const float *C, uint64_t M, uint64_t N, uint64_t K)
+{
+    double error = 0.0;
+    for (uint64_t i = 0; i < M; i++)
+    {
+        for (uint64_t j = 0; j < N; j++)
+        {
+            double ref = 0.0;
+            for (uint64_t k = 0; k < K; k++)
+                ref += (double)A[i * K + k] * B[k * N + j];
+            double e = std::fabs(C[i * N + j] - ref) / std::fabs(ref);
+            error = e > error || std::isnan(e) ? e : error;
+        }
+    }
+    return error;
+}
+
+template <uint64_t M, uint64_t N, uint64_t K>
+static int check()
+{
+    float *A = (float *)aligned_alloc(128, M * K * sizeof(float));
+    float *B = (float *)aligned_alloc(128, K * N * sizeof(float));
+    float *C = (float *)aligned_alloc(128, M * N * sizeof(float));
+    for (uint64_t i = 0; i < M * K; i++)
+        A[i] = (rand() % 20 + 1) / 100.0;
+    for (uint64_t i = 0; i < K * N; i++)
+        B[i] = (rand() % 20 + 1) / 100.0;
+
+    int failed = 0;
+    for (int kernel = 0; kernel < 2; kernel++)
+    {
+        for (uint64_t i = 0; i < M * N; i++)
+            C[i] = NAN;
+        if (kernel)
+        {
+            AMX_START();
+            amx::gemm_kernel<M, N, K>(A, B, C);
+            AMX_STOP();
+        }
+        else
+        {
+            amx::gemm<M, N, K>(A, B, C);
+        }
+        double error = max_error(A, B, C, M, N, K);
+        failed |= !(error <= 1e-5);
+        printf("%4llu %4llu %4llu  %-11s max relative error %g%s\n", (unsigned long long)M,
+               (unsigned long long)N, (unsigned long long)K, kernel ? "gemm_kernel" : "gemm", error,
+               error <= 1e-5 ? "" : ", FAILED");
+    }
+
+    free(A);
+    free(B);
+    free(C);
+    return failed;
+}
+
+int main()
+{
+    int failed = 0;
+    failed |= check<16, 16, 16>();
+    failed |= check<32, 32, 32>();
+    failed |= check<64, 64, 64>();
+    failed |= check<48, 16, 32>();
+    failed |= check<16, 48, 16>();
+    failed |= check<32, 80, 48>();
+    printf(failed ? "FAILED\n" : "passed\n");
+    return failed;
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ *  counters and phase timers of the sgemm kernels
+ *
+ *  built with -DAMX_SGEMM_STATS, every kernel call counts into the stats of
+ *  its thread, and into the global stats when it returns. without it the
+ *  AMX_SGEMM_STATS_* macros are empty and the kernels are unchanged; the
+ *  query functions still exist and return zeros.
+ *
+ *  amx_sgemm_stats_enable(0) stops counting at runtime, so a long running
+ *  program can sample a few calls now and then.
+ */
+
+enum AMX_SGEMM_PHASE
+{
+    AMX_SGEMM_PHASE_PACK_A = 0,  // A to A0, by amx (transformA) or cpu (transformB of A^T)
+    AMX_SGEMM_PHASE_PACK_B = 1,  // B to B0
+    AMX_SGEMM_PHASE_COMPUTE = 2, // loads and fmas of the tiles
+    AMX_SGEMM_PHASE_STORE = 3,   // z to C
+    AMX_SGEMM_PHASES = 4
+};
+
+/* every field is a uint64_t sum, so stats add up field by field */
+struct amx_sgemm_stats
+{
+    uint64_t calls;
+    uint64_t flops;          // 2 * sizei * sizej * sizek of every call
+    uint64_t bytes_packed_a; // written to A0
+    uint64_t bytes_packed_b; // written to B0
+    uint64_t ns_call;        // in the kernels, allocation and AMX_START included
+    uint64_t ns_phase[AMX_SGEMM_PHASES];
+    uint64_t amx_starts;
+    uint64_t amx_stops;
+};
+
+#define AMX_SGEMM_STATS_FIELDS (sizeof(struct amx_sgemm_stats) / sizeof(uint64_t))
+
+static int amx_sgemm_stats_enabled = 1;
+static struct amx_sgemm_stats amx_sgemm_stats_all;
+static __thread struct amx_sgemm_stats amx_sgemm_stats_thread_total;
+// state of the call running on this thread
+static __thread struct amx_sgemm_stats amx_sgemm_stats_before;
+static __thread int amx_sgemm_stats_active = 0;
+static __thread int amx_sgemm_stats_phase_now = -1;
+static __thread uint64_t amx_sgemm_stats_mark;
+static __thread uint64_t amx_sgemm_stats_start;
+
+static inline uint64_t amx_sgemm_stats_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return 1000000000ull * (uint64_t)now.tv_sec + (uint64_t)now.tv_nsec;
+}
+
+/* counts from now on, on every thread */
+void amx_sgemm_stats_enable(int enable)
+{
+    __atomic_store_n(&amx_sgemm_stats_enabled, enable, __ATOMIC_RELAXED);
+}
+
+/* what this thread counted */
+struct amx_sgemm_stats amx_sgemm_stats_thread(void)
+{
+    return amx_sgemm_stats_thread_total;
+}
+
+/* what all threads counted, calls running on other threads are not in yet */
+struct amx_sgemm_stats amx_sgemm_stats_global(void)
+{
+    struct amx_sgemm_stats stats;
+    const uint64_t *from = (const uint64_t *)&amx_sgemm_stats_all;
+    uint64_t *to = (uint64_t *)&stats;
+    for (uint64_t f = 0; f < AMX_SGEMM_STATS_FIELDS; f++)
+        to[f] = __atomic_load_n(&from[f], __ATOMIC_RELAXED);
+    return stats;
+}
+
+/* zeros the global stats and the ones of this thread */
+void amx_sgemm_stats_reset(void)
+{
+    uint64_t *all = (uint64_t *)&amx_sgemm_stats_all;
+    for (uint64_t f = 0; f < AMX_SGEMM_STATS_FIELDS; f++)
+        __atomic_store_n(&all[f], 0ull, __ATOMIC_RELAXED);
+    memset(&amx_sgemm_stats_thread_total, 0, sizeof amx_sgemm_stats_thread_total);
+}
+
+/* stats = after - before, for the calls of a region */
+struct amx_sgemm_stats amx_sgemm_stats_diff(const struct amx_sgemm_stats *after,
+                                            const struct amx_sgemm_stats *before)
+{
+    struct amx_sgemm_stats stats;
+    const uint64_t *a = (const uint64_t *)after;
+    const uint64_t *b = (const uint64_t *)before;
+    uint64_t *to = (uint64_t *)&stats;
+    for (uint64_t f = 0; f < AMX_SGEMM_STATS_FIELDS; f++)
+        to[f] = a[f] - b[f];
+    return stats;
+}
+
+void amx_sgemm_stats_print(const struct amx_sgemm_stats *stats, FILE *file)
+{
+    static const char *names[AMX_SGEMM_PHASES] = {"pack A", "pack B", "compute", "store"};
+    double call = stats->ns_call ? (double)stats->ns_call : 1.0;
+    fprintf(file, "calls: %llu, flops: %llu, %.3f GFLOP/s\n",
+            (unsigned long long)stats->calls, (unsigned long long)stats->flops,
+            (double)stats->flops / call);
+    fprintf(file, "packed: A %llu bytes, B %llu bytes\n",
+            (unsigned long long)stats->bytes_packed_a, (unsigned long long)stats->bytes_packed_b);
+    uint64_t phases = 0;
+    for (int p = 0; p < AMX_SGEMM_PHASES; p++)
+    {
+        fprintf(file, "%s: %.3f ms (%.1f%%)\n", names[p], stats->ns_phase[p] / 1e6,
+                100.0 * stats->ns_phase[p] / call);
+        phases += stats->ns_phase[p];
+    }
+    fprintf(file, "other: %.3f ms, total: %.3f ms\n",
+            (stats->ns_call - phases) / 1e6, stats->ns_call / 1e6);
+    fprintf(file, "amx start: %llu, stop: %llu\n",
+            (unsigned long long)stats->amx_starts, (unsigned long long)stats->amx_stops);
+}
+
+/* the time since the last switch goes to the phase that ends, -1 for none */
+static inline void amx_sgemm_stats_switch(int phase)
+{
+    uint64_t now = amx_sgemm_stats_ns();
+    if (amx_sgemm_stats_phase_now >= 0)
+        amx_sgemm_stats_thread_total.ns_phase[amx_sgemm_stats_phase_now] += now - amx_sgemm_stats_mark;
+    amx_sgemm_stats_phase_now = phase;
+    amx_sgemm_stats_mark = now;
+}
+
+static inline void amx_sgemm_stats_begin(uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    amx_sgemm_stats_active = __atomic_load_n(&amx_sgemm_stats_enabled, __ATOMIC_RELAXED);
+    if (!amx_sgemm_stats_active)
+        return;
+    amx_sgemm_stats_before = amx_sgemm_stats_thread_total;
+    amx_sgemm_stats_thread_total.calls++;
+    amx_sgemm_stats_thread_total.flops += 2ull * sizei * sizej * sizek;
+    amx_sgemm_stats_phase_now = -1;
+    amx_sgemm_stats_start = amx_sgemm_stats_ns();
+    amx_sgemm_stats_mark = amx_sgemm_stats_start;
+}
+
+static inline void amx_sgemm_stats_end(void)
+{
+    if (!amx_sgemm_stats_active)
+        return;
+    amx_sgemm_stats_switch(-1);
+    amx_sgemm_stats_thread_total.ns_call += amx_sgemm_stats_mark - amx_sgemm_stats_start;
+    struct amx_sgemm_stats call = amx_sgemm_stats_diff(&amx_sgemm_stats_thread_total, &amx_sgemm_stats_before);
+    const uint64_t *from = (const uint64_t *)&call;
+    uint64_t *all = (uint64_t *)&amx_sgemm_stats_all;
+    for (uint64_t f = 0; f < AMX_SGEMM_STATS_FIELDS; f++)
+        if (from[f])
+            __atomic_fetch_add(&all[f], from[f], __ATOMIC_RELAXED);
+    amx_sgemm_stats_active = 0;
+}
+
+#ifdef AMX_SGEMM_STATS
+
+#define AMX_SGEMM_STATS_BEGIN(I, J, K) amx_sgemm_stats_begin(I, J, K)
+#define AMX_SGEMM_STATS_END() amx_sgemm_stats_end()
+#define AMX_SGEMM_STATS_PHASE(P)       \
+    do                                 \
+    {                                  \
+        if (amx_sgemm_stats_active)    \
+            amx_sgemm_stats_switch(P); \
+    } while (0)
+#define AMX_SGEMM_STATS_ADD(FIELD, V)                  \
+    do                                                 \
+    {                                                  \
+        if (amx_sgemm_stats_active)                    \
+            amx_sgemm_stats_thread_total.FIELD += (V); \
+    } while (0)
+
+#else
+
+#define AMX_SGEMM_STATS_BEGIN(I, J, K) ((void)0)
+#define AMX_SGEMM_STATS_END() ((void)0)
+#define AMX_SGEMM_STATS_PHASE(P) ((void)0)
+#define AMX_SGEMM_STATS_ADD(FIELD, V) ((void)0)
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ *  amx_trace_check: enable and disable amx tracing (dougallj/amx_trace.h)
+ *  several times on the simulator, and check every round writes its trace
+ *
+ *  usage: ./amx_trace_check [path]
+ *  traces go to path.0, path.1, ... (default /tmp/amx_trace_check)
+ *  round 0: AMX_TRACE_MAX_THREADS threads take every writer, so the main
+ *           thread finds the table full and is not traced
+ *  rounds 1, 2: the main thread alone, with round + 1 loads; it must drop the
+ *           writer freed by amx_trace_disable and the full flag of round 0
+ *  returns 1 if a trace is missing or has the wrong count of loads
+ */
+
+// compile options: -O3 -DAMX_SIMULATOR -o amx_trace_check -lm -lpthread
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../dougallj/amx.h"
+
+#ifndef AMX_SIMULATOR
+#error "amx_trace_check needs -DAMX_SIMULATOR"
+#endif
+
+#define ROUNDS 3
+
+static float row[16] __attribute__((aligned(128)));
+
+static void loads(int count)
+{
+    AMX_START();
+    for (int i = 0; i < count; i++)
+        AMX_LDX((uint64_t)row);
+    AMX_STOP();
+}
+
+static void *worker(void *arg)
+{
+    (void)arg;
+    loads(1);
+    return NULL;
+}
+
+/* loads recorded in a trace, -1 if it can not be read */
+static int count_loads(const char *path)
+{
+    struct amx_trace_reader reader;
+    struct amx_trace_record record;
+    const uint8_t *memory;
+    int result, count = 0;
+    if (amx_trace_map(&reader, path))
+        return -1;
+    while ((result = amx_trace_next(&reader, &record, &memory)) == 1)
+        count += record.op == AMX_OP_LDX;
+    amx_trace_unmap(&reader);
+    return result ? -1 : count;
+}
+
+static int expect(const char *path, int loads)
+{
+    int count = count_loads(path);
+    if (count == loads)
+        return 0;
+    printf("Error: %s has %d loads, %d expected\n", path, count, loads);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *base = argc > 1 ? argv[1] : "/tmp/amx_trace_check";
+    char path[4096], file[4096 + 32];
+    int failed = 0;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        snprintf(path, sizeof path, "%s.%d", base, round);
+        amx_trace_enable(path);
+        if (round == 0)
+        {
+            pthread_t threads[AMX_TRACE_MAX_THREADS];
+            for (int t = 0; t < AMX_TRACE_MAX_THREADS; t++)
+                pthread_create(&threads[t], NULL, worker, NULL);
+            for (int t = 0; t < AMX_TRACE_MAX_THREADS; t++)
+                pthread_join(threads[t], NULL);
+            loads(1); // table full, not traced
+        }
+        else
+        {
+            loads(round + 1);
+        }
+        amx_trace_disable();
+
+        if (round == 0)
+        {
+            for (int t = 0; t < AMX_TRACE_MAX_THREADS; t++)
+            {
+                snprintf(file, sizeof file, "%s.%d", path, t);
+                failed |= expect(file, 1);
+                unlink(file);
+            }
+            snprintf(file, sizeof file, "%s.%d", path, AMX_TRACE_MAX_THREADS);
+            if (access(file, F_OK) == 0)
+            {
+                printf("Error: %s written past the table of writers\n", file);
+                failed = 1;
+            }
+        }
+        else
+        {
+            snprintf(file, sizeof file, "%s.0", path);
+            failed |= expect(file, round + 1);
+            unlink(file);
+        }
+        printf("round %d: %s\n", round, failed ? "FAILED" : "ok");
+    }
+    printf(failed ? "FAILED\n" : "passed\n");
+    return failed;
+}
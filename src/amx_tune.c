@@ -0,0 +1,168 @@
+/*
+ *  amx_tune: sweep blocking, loop order and unroll of the packed kernel
+ *  and write the fastest config of each shape bucket to the tuning database
+ *
+ *  usage: ./amx_tune [-o amx_tune.db] [-r repetition] [M N K]...
+ *  without shapes, the square shapes of the benchmark and some skinny ones are tuned
+ *  existing entries of the database are kept unless their bucket is tuned again
+ */
+
+// compile options: -O3 -o amx_tune
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "amx_sgemm.3.h"
+
+#define TUNE_REPETITION 8
+
+static const uint64_t block_is[] = {1ull, 2ull, 4ull, 8ull, 0ull};
+static const uint64_t block_js[] = {1ull, 2ull, 4ull, 8ull, 16ull, 0ull};
+static const uint64_t orders[] = {AMX_LOOP_IJ, AMX_LOOP_JI};
+static const uint64_t unrolls[] = {1ull, 2ull, 4ull};
+
+static const uint64_t default_shapes[][3] = {
+    {64, 64, 64}, {128, 128, 128}, {256, 256, 256}, {512, 512, 512},
+    {1024, 1024, 1024}, {2048, 2048, 2048}, {4096, 4096, 4096},
+    {32, 4096, 4096}, {64, 4096, 4096}, {4096, 32, 4096}, {4096, 4096, 32},
+};
+
+static uint64_t now_us(void)
+{
+    struct timeval time;
+    gettimeofday(&time, NULL);
+    return 1000000ull * time.tv_sec + time.tv_usec;
+}
+
+/* best time of the packed kernel with a config, in us */
+static uint64_t time_config(const float *A0, const float *B0, float *C,
+                            uint64_t sizei, uint64_t sizej, uint64_t sizek,
+                            const struct amx_sgemm_config *config, int repetition)
+{
+    uint64_t best = UINT64_MAX;
+    AMX_START();
+    amx_sgemm_packed(A0, B0, C, sizei, sizej, sizek, config);
+    for (int r = 0; r < repetition; r++)
+    {
+        uint64_t start = now_us();
+        amx_sgemm_packed(A0, B0, C, sizei, sizej, sizek, config);
+        uint64_t diff = now_us() - start;
+        best = diff < best ? diff : best;
+    }
+    AMX_STOP();
+    return best ? best : 1ull;
+}
+
+static int tune_shape(uint64_t sizei, uint64_t sizej, uint64_t sizek, int repetition)
+{
+    if (sizei == 0ull || sizej == 0ull || sizek == 0ull ||
+        sizei % 32 != 0 || sizej % 32 != 0 || sizek % 32 != 0)
+    {
+        printf("skip %llu %llu %llu: sizes should be multiples of 32\n",
+               (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek);
+        return -1;
+    }
+    float *A = (float *)aligned_alloc(128, sizei * sizek * sizeof(float));
+    float *B = (float *)aligned_alloc(128, sizek * sizej * sizeof(float));
+    float *A0 = (float *)aligned_alloc(128, sizei * sizek * sizeof(float));
+    float *B0 = (float *)aligned_alloc(128, sizek * sizej * sizeof(float));
+    float *C = (float *)aligned_alloc(128, sizei * sizej * sizeof(float));
+    float *C0 = (float *)aligned_alloc(128, sizei * sizej * sizeof(float));
+    srand(7);
+    for (uint64_t i = 0; i < sizei * sizek; i++)
+        A[i] = (rand() % 20 + 1) / 100.0;
+    for (uint64_t i = 0; i < sizek * sizej; i++)
+        B[i] = (rand() % 20 + 1) / 100.0;
+    transformB(B, B0, sizek, sizej);
+    AMX_START();
+    transformA(A, A0, sizei, sizek);
+    AMX_STOP();
+
+    // every config sums k in the same order, so results must be the same bits
+    struct amx_sgemm_config best_config = amx_tune_default_config();
+    uint64_t best = time_config(A0, B0, C0, sizei, sizej, sizek, &best_config, repetition);
+    uint64_t base = best;
+    for (uint64_t bi = 0; bi < sizeof(block_is) / sizeof(block_is[0]); bi++)
+        for (uint64_t bj = 0; bj < sizeof(block_js) / sizeof(block_js[0]); bj++)
+            for (uint64_t o = 0; o < sizeof(orders) / sizeof(orders[0]); o++)
+                for (uint64_t u = 0; u < sizeof(unrolls) / sizeof(unrolls[0]); u++)
+                {
+                    struct amx_sgemm_config config = {block_is[bi], block_js[bj], orders[o], unrolls[u]};
+                    uint64_t diff = time_config(A0, B0, C, sizei, sizej, sizek, &config, repetition);
+                    if (memcmp(C, C0, sizei * sizej * sizeof(float)))
+                    {
+                        printf("Error: config %llu %llu %llu %llu gives a different result\n",
+                               (unsigned long long)config.block_i, (unsigned long long)config.block_j,
+                               (unsigned long long)config.order, (unsigned long long)config.unroll);
+                        continue;
+                    }
+                    if (diff < best)
+                    {
+                        best = diff;
+                        best_config = config;
+                    }
+                }
+
+    double gflops = 2.0 * sizei * sizej * sizek / best / 1e3;
+    printf("%5llu %5llu %5llu: block_i %2llu block_j %2llu order %llu unroll %llu  %9.3f GFLOP/s (default %9.3f)\n",
+           (unsigned long long)sizei, (unsigned long long)sizej, (unsigned long long)sizek,
+           (unsigned long long)best_config.block_i, (unsigned long long)best_config.block_j,
+           (unsigned long long)best_config.order, (unsigned long long)best_config.unroll,
+           gflops, 2.0 * sizei * sizej * sizek / base / 1e3);
+    amx_tune_update(sizei, sizej, sizek, best_config, gflops);
+
+    free(A);
+    free(B);
+    free(A0);
+    free(B0);
+    free(C);
+    free(C0);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = getenv("AMX_TUNE_DB");
+    int repetition = TUNE_REPETITION;
+    int arg = 1;
+    path = path ? path : AMX_TUNE_DEFAULT_DB;
+    for (; arg < argc && argv[arg][0] == '-'; arg += 2)
+    {
+        if (arg + 1 >= argc)
+        {
+            printf("usage: %s [-o database] [-r repetition] [M N K]...\n", argv[0]);
+            return -1;
+        }
+        if (strcmp(argv[arg], "-o") == 0)
+            path = argv[arg + 1];
+        else if (strcmp(argv[arg], "-r") == 0)
+            repetition = atoi(argv[arg + 1]);
+    }
+    if ((argc - arg) % 3 != 0)
+    {
+        printf("usage: %s [-o database] [-r repetition] [M N K]...\n", argv[0]);
+        return -1;
+    }
+
+    // the constructor loaded $AMX_TUNE_DB, reload if another database is written
+    amx_tune_db_size = 0;
+    amx_tune_load(path);
+
+    if (arg == argc)
+    {
+        for (uint64_t s = 0; s < sizeof(default_shapes) / sizeof(default_shapes[0]); s++)
+            tune_shape(default_shapes[s][0], default_shapes[s][1], default_shapes[s][2], repetition);
+    }
+    for (; arg + 2 < argc; arg += 3)
+        tune_shape(strtoull(argv[arg], NULL, 10), strtoull(argv[arg + 1], NULL, 10),
+                   strtoull(argv[arg + 2], NULL, 10), repetition);
+
+    if (amx_tune_save(path))
+    {
+        printf("Error: can not write %s\n", path);
+        return -1;
+    }
+    printf("Saved %llu entries to %s\n", (unsigned long long)amx_tune_db_size, path);
+    return 0;
+}
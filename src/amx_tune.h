@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ *  tuning database of the packed kernel (amx_sgemm.3.h)
+ *
+ *  written by amx_tune.c, loaded at startup from $AMX_TUNE_DB or ./amx_tune.db
+ *  one line per shape bucket, a bucket is log2 of each size rounded down:
+ *      log2(sizei) log2(sizej) log2(sizek) block_i block_j order unroll gflops
+ */
+
+#define AMX_TUNE_DEFAULT_DB "amx_tune.db"
+#define AMX_TUNE_MAX_ENTRIES 1024
+// larger values in a database are corrupt: 2^32 floats per size, 2^20 tiles per block
+#define AMX_TUNE_MAX_BUCKET 32ull
+#define AMX_TUNE_MAX_BLOCK (1ull << 20)
+
+enum AMX_LOOP_ORDER
+{
+    AMX_LOOP_IJ = 0, // j tiles inside i tiles
+    AMX_LOOP_JI = 1  // i tiles inside j tiles
+};
+
+/*
+ *  block_i, block_j: 32x32 tiles of C in a cache block, 0 for the whole size
+ *  order: order of the blocks, and of the tiles in a block
+ *  unroll: k steps loaded together in the microkernel, 1, 2 or 4
+ */
+struct amx_sgemm_config
+{
+    uint64_t block_i;
+    uint64_t block_j;
+    uint64_t order;
+    uint64_t unroll;
+};
+
+struct amx_tune_entry
+{
+    uint64_t bucket_i;
+    uint64_t bucket_j;
+    uint64_t bucket_k;
+    struct amx_sgemm_config config;
+    double gflops;
+};
+
+static struct amx_tune_entry amx_tune_db[AMX_TUNE_MAX_ENTRIES];
+static uint64_t amx_tune_db_size = 0;
+
+uint64_t amx_tune_bucket(uint64_t size)
+{
+    uint64_t bucket = 0ull;
+    while (size >>= 1)
+        bucket++;
+    return bucket;
+}
+
+/* the untuned kernel: 32x32 tiles, i-j-k order, no unroll */
+struct amx_sgemm_config amx_tune_default_config(void)
+{
+    struct amx_sgemm_config config = {1ull, 0ull, AMX_LOOP_IJ, 1ull};
+    return config;
+}
+
+struct amx_tune_entry *amx_tune_find(uint64_t bucket_i, uint64_t bucket_j, uint64_t bucket_k)
+{
+    for (uint64_t e = 0; e < amx_tune_db_size; e++)
+    {
+        struct amx_tune_entry *entry = &amx_tune_db[e];
+        if (entry->bucket_i == bucket_i && entry->bucket_j == bucket_j && entry->bucket_k == bucket_k)
+            return entry;
+    }
+    return NULL;
+}
+
+/* tuned config of the bucket of a shape, or the default one */
+struct amx_sgemm_config amx_tune_lookup(uint64_t sizei, uint64_t sizej, uint64_t sizek)
+{
+    struct amx_tune_entry *entry = amx_tune_find(amx_tune_bucket(sizei),
+                                                 amx_tune_bucket(sizej),
+                                                 amx_tune_bucket(sizek));
+    return entry ? entry->config : amx_tune_default_config();
+}
+
+/* add or replace the entry of the bucket of a shape, return 0 on success */
+int amx_tune_update(uint64_t sizei, uint64_t sizej, uint64_t sizek,
+                    struct amx_sgemm_config config, double gflops)
+{
+    uint64_t bucket_i = amx_tune_bucket(sizei);
+    uint64_t bucket_j = amx_tune_bucket(sizej);
+    uint64_t bucket_k = amx_tune_bucket(sizek);
+    struct amx_tune_entry *entry = amx_tune_find(bucket_i, bucket_j, bucket_k);
+    if (entry == NULL)
+    {
+        if (amx_tune_db_size == AMX_TUNE_MAX_ENTRIES)
+            return -1;
+        entry = &amx_tune_db[amx_tune_db_size++];
+        entry->bucket_i = bucket_i;
+        entry->bucket_j = bucket_j;
+        entry->bucket_k = bucket_k;
+    }
+    entry->config = config;
+    entry->gflops = gflops;
+    return 0;
+}
+
+static int amx_tune_valid(const struct amx_sgemm_config *config)
+{
+    return config->block_i <= AMX_TUNE_MAX_BLOCK && config->block_j <= AMX_TUNE_MAX_BLOCK &&
+           config->order <= AMX_LOOP_JI &&
+           (config->unroll == 1ull || config->unroll == 2ull || config->unroll == 4ull);
+}
+
+/* load a database, return the number of entries read or -1 if it can not be opened */
+int amx_tune_load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+    int count = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned long long v[7];
+        double gflops;
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%llu %llu %llu %llu %llu %llu %llu %lf",
+                   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &gflops) != 8)
+            continue;
+        if (v[0] > AMX_TUNE_MAX_BUCKET || v[1] > AMX_TUNE_MAX_BUCKET || v[2] > AMX_TUNE_MAX_BUCKET)
+            continue;
+        struct amx_sgemm_config config = {v[3], v[4], v[5], v[6]};
+        if (!amx_tune_valid(&config))
+            continue;
+        if (amx_tune_update(1ull << v[0], 1ull << v[1], 1ull << v[2], config, gflops))
+            break;
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+/* write all entries, return 0 on success */
+int amx_tune_save(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return -1;
+    fprintf(file, "# log2(sizei) log2(sizej) log2(sizek) block_i block_j order unroll gflops\n");
+    for (uint64_t e = 0; e < amx_tune_db_size; e++)
+    {
+        struct amx_tune_entry *entry = &amx_tune_db[e];
+        fprintf(file, "%llu %llu %llu %llu %llu %llu %llu %.3f\n",
+                (unsigned long long)entry->bucket_i,
+                (unsigned long long)entry->bucket_j,
+                (unsigned long long)entry->bucket_k,
+                (unsigned long long)entry->config.block_i,
+                (unsigned long long)entry->config.block_j,
+                (unsigned long long)entry->config.order,
+                (unsigned long long)entry->config.unroll,
+                entry->gflops);
+    }
+    return fclose(file);
+}
+
+/* load the database once at startup, before any thread calls the kernel */
+__attribute__((constructor)) static void amx_tune_init(void)
+{
+    const char *path = getenv("AMX_TUNE_DB");
+    amx_tune_load(path ? path : AMX_TUNE_DEFAULT_DB);
+}
@@ -149,7 +149,7 @@ int main()
         // my code using amx
 #pragma omp for
         for (int i = 0; i < 8; i++)
-            _amx_sgemm(&MatrixA[i][0][0],
+            _amx_sgemm_3(&MatrixA[i][0][0],
                        &MatrixB[i][0][0],
                        &MatrixC[i][0][0],
                        MATRIX_M, MATRIX_N, MATRIX_K);
@@ -165,7 +165,7 @@ int main()
             gettimeofday(&omp_time, NULL);
             printf(">>> start: %d %d %ld\n", omp_get_thread_num(), i, (omp_time.tv_sec - base_time) * 1000000 + omp_time.tv_usec);
             for (int j = 0; j < OMP_SGEMM_REPETITION; j++)
-                _amx_sgemm(&MatrixA[i][0][0],
+                _amx_sgemm_3(&MatrixA[i][0][0],
                            &MatrixB[i][0][0],
                            &MatrixC[i][0][0],
                            MATRIX_M, MATRIX_N, MATRIX_K);
@@ -153,7 +153,7 @@ int main()
         {
             int tid = omp_get_thread_num();
 #ifndef OMP_NO_PREHOT
-            _amx_sgemm(&MatrixA[tid * a_per_thread][0][0],
+            _amx_sgemm_3(&MatrixA[tid * a_per_thread][0][0],
                        &MatrixB[0][0],
                        &MatrixC[tid * a_per_thread][0][0],
                        MATRIX_M * a_per_thread, MATRIX_N, MATRIX_K);
@@ -163,7 +163,7 @@ int main()
                 printf("My_AMX_SGEMM---Time: ");
                 gettimeofday(&start, NULL);
             }
-            _amx_sgemm(&MatrixA[tid * a_per_thread][0][0],
+            _amx_sgemm_3(&MatrixA[tid * a_per_thread][0][0],
                        &MatrixB[0][0],
                        &MatrixC[tid * a_per_thread][0][0],
                        MATRIX_M * a_per_thread, MATRIX_N, MATRIX_K);
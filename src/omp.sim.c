@@ -0,0 +1,126 @@
+// compile options: -O3 -fopenmp -DAMX_SIMULATOR -lm
+/*
+ *  the amx part of omp.exp3.c on the simulator: 8 sgemm split between 1, 2, 4
+ *  and 8 threads, with wall and per job times predicted by the contention
+ *  model of dougallj/amx_contention.h instead of measured
+ *
+ *  usage: ./a.out [units [quantum_cycles [cpu_scale]]]
+ *  cpu work (transformB, allocation) is the thread cpu time of the host, times cpu_scale
+ */
+#include <omp.h>
+#include <stdio.h>
+
+#include "amx_sgemm.3.h"
+#include "../dougallj/amx_contention.h"
+
+#ifndef AMX_SIMULATOR
+#error "omp.sim.c needs -DAMX_SIMULATOR"
+#endif
+
+#ifdef OMP_MATRIX_SIZE
+#define MATRIX_M OMP_MATRIX_SIZE
+#define MATRIX_N OMP_MATRIX_SIZE
+#define MATRIX_K OMP_MATRIX_SIZE
+#else
+#ifdef OMP_MATRIX_SIZE_M
+#define MATRIX_M OMP_MATRIX_SIZE_M
+#else
+#define MATRIX_M 512
+#endif
+#ifdef OMP_MATRIX_SIZE_N
+#define MATRIX_N OMP_MATRIX_SIZE_N
+#else
+#define MATRIX_N 512
+#endif
+#ifdef OMP_MATRIX_SIZE_K
+#define MATRIX_K OMP_MATRIX_SIZE_K
+#else
+#define MATRIX_K 512
+#endif
+#endif
+
+#ifndef OMP_SGEMM_REPETITION
+#define OMP_SGEMM_REPETITION 1
+#endif
+
+__attribute__((aligned(0x80))) float MatrixA[8][MATRIX_M][MATRIX_K];
+__attribute__((aligned(0x80))) float MatrixB[8][MATRIX_K][MATRIX_N];
+__attribute__((aligned(0x80))) float MatrixC[8][MATRIX_M][MATRIX_N];
+
+void initMatrixAB()
+{
+    srand(7);
+    for (int num = 0; num < 8; num++)
+        for (int i = 0; i < MATRIX_M; i++)
+            for (int j = 0; j < MATRIX_K; j++)
+                MatrixA[num][i][j] = (rand() % 20 + 1 + num) / 100.0;
+    for (int num = 0; num < 8; num++)
+        for (int i = 0; i < MATRIX_K; i++)
+            for (int j = 0; j < MATRIX_N; j++)
+                MatrixB[num][i][j] = (rand() % 20 + 1 + num) / 100.0;
+}
+
+int main(int argc, char **argv)
+{
+    struct amx_contention_params params = amx_contention_default_params();
+    if (argc > 1)
+        params.units = atoi(argv[1]);
+    if (argc > 2)
+        params.quantum_cycles = atof(argv[2]);
+    if (argc > 3)
+        params.cpu_scale = atof(argv[3]);
+    initMatrixAB();
+
+    printf("Running with settings: repetition %d, M %d, K %d, N %d, amx units %d, quantum %.0f cycles, cpu scale %.2f\n\n",
+           OMP_SGEMM_REPETITION, MATRIX_M, MATRIX_K, MATRIX_N, params.units, params.quantum_cycles, params.cpu_scale);
+
+    double single = 0;
+    for (int thread_num = 1; thread_num <= 8; thread_num *= 2)
+    {
+        omp_set_num_threads(thread_num);
+        amx_contention_record(NULL);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < 8; i++)
+        {
+            amx_contention_begin_job(i);
+            for (int j = 0; j < OMP_SGEMM_REPETITION; j++)
+                _amx_sgemm_3(&MatrixA[i][0][0],
+                             &MatrixB[i][0][0],
+                             &MatrixC[i][0][0],
+                             MATRIX_M, MATRIX_N, MATRIX_K);
+        }
+        int count;
+        struct amx_contention_thread *threads = amx_contention_stop(&count);
+        double wall = amx_contention_predict(&params, threads, count);
+        double us = wall / (params.frequency_ghz * 1e3);
+        if (thread_num == 1)
+            single = wall;
+
+        printf("AMX_SGEMM threads %d time: %.0f (speedup %.2f)\n", thread_num, us, single / wall);
+        for (int i = 0; i < 8; i++)
+        {
+            int thread = -1;
+            double begin = 0, end = 0;
+            for (int t = 0; t < count; t++)
+                for (int s = 0; s < threads[t].count; s++)
+                {
+                    struct amx_contention_segment *segment = &threads[t].segments[s];
+                    if (segment->job != i)
+                        continue;
+                    if (thread < 0 || segment->begin < begin)
+                        begin = segment->begin;
+                    if (segment->end > end)
+                        end = segment->end;
+                    thread = t;
+                }
+            printf("%d\t%d\t%5.0f\t%5.0f\n", i, thread,
+                   begin / (params.frequency_ghz * 1e3), end / (params.frequency_ghz * 1e3));
+        }
+        for (int t = 0; t < count; t++)
+            printf("thread %d: waited %.0f, save/restore %.0f\n", t,
+                   threads[t].waited / (params.frequency_ghz * 1e3),
+                   threads[t].switches / (params.frequency_ghz * 1e3));
+        printf("\n");
+    }
+    return 0;
+}